@@ -0,0 +1,154 @@
+#include "CAdcSampler.h"
+#include <time.h>
+#include <errno.h>
+
+using namespace std;
+
+// each MCP3002 reading is a 3 byte transfer, 24 clocks
+#define CLOCKS_PER_READING 24
+
+CAdcSampler::CAdcSampler(CBackend& gpio) : gpio(gpio) {
+    handle = -1;
+    period_ns = 1000000;
+    active_period_ns = 1000000;
+    oversample = 1;
+    running = false;
+    snapshot = 0;
+    published = 0;
+}
+
+CAdcSampler::~CAdcSampler() {
+    stop();
+}
+
+bool CAdcSampler::start(int rate_hz, int oversample, int baud) {
+    stop();
+
+    if (rate_hz <= 0 || oversample <= 0 || baud <= 0) return false;
+
+    // two readings per pair, leave a quarter of the bus time for the gaps between transfers
+    int max_rate = baud / (2 * CLOCKS_PER_READING) * 3 / 4;
+    if (rate_hz > max_rate) rate_hz = max_rate;
+
+    period_ns = 1000000000 / rate_hz;
+    active_period_ns = period_ns;
+    this->oversample = oversample;
+
+    handle = gpio.spi_open(0, baud, 3); // Mode 0
+    if (handle < 0) return false;
+
+    // the first block is read here so there is always a snapshot once start returns
+    int sums[2] = {0, 0};
+    for (int i = 0; i < oversample; i++) {
+        if (!sample(sums)) {
+            gpio.spi_close(handle);
+            handle = -1;
+            return false;
+        }
+    }
+    publish(sums);
+
+    running = true;
+    sampler = thread(&CAdcSampler::sample_loop, this);
+    return true;
+}
+
+void CAdcSampler::stop() {
+    if (running) {
+        running = false;
+        sampler.join();
+    }
+
+    if (handle >= 0) {
+        gpio.spi_close(handle);
+        handle = -1;
+    }
+
+    // readers get -1 again rather than the last reading before the stop
+    published = 0;
+}
+
+bool CAdcSampler::read(int channel, int& result) const {
+    double v = value(channel);
+    if (v < 0) return false;
+
+    result = (int)(v + 0.5);
+    return true;
+}
+
+double CAdcSampler::value(int channel) const {
+    if (channel < 0 || channel > 1 || published == 0) return -1;
+
+    uint64_t s = snapshot.load(memory_order_acquire);
+    return ((s >> (24 * channel)) & 0xFFFFFF) / 256.0;
+}
+
+void CAdcSampler::set_idle(bool idle) {
+    period_ns = idle ? 100000000 : active_period_ns;
+}
+
+unsigned long CAdcSampler::blocks() const {
+    return published;
+}
+
+int CAdcSampler::rate() const {
+    return 1000000000 / period_ns;
+}
+
+bool CAdcSampler::sample(int counts[2]) {
+    for (int channel = 0; channel < 2; channel++) {
+        unsigned char inBuf[3];
+        char cmd[] = {1, (char)(channel == 0 ? 0b10000000 : 0b10010000), 0}; // 0b1XXX0000 where XXX is the channel
+
+        if (gpio.spi_xfer(handle, cmd, (char*) inBuf, 3) != 3) return false; // Transfer 3 bytes
+        counts[channel] += ((inBuf[1] & 3) << 8) | inBuf[2]; // Format 10 bits
+    }
+
+    return true;
+}
+
+void CAdcSampler::publish(const int sums[2]) {
+    uint64_t s = 0;
+
+    for (int channel = 0; channel < 2; channel++) {
+        uint64_t avg = ((uint64_t)sums[channel] * 256 + oversample / 2) / oversample;
+        s |= (avg & 0xFFFFFF) << (24 * channel);
+    }
+
+    unsigned long n = published + 1;
+    s |= (uint64_t)(n & 0xFFFF) << 48;
+
+    snapshot.store(s, memory_order_release);
+    published = n;
+}
+
+void CAdcSampler::sample_loop() {
+    timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    int sums[2] = {0, 0};
+    int count = 0;
+
+    while (running) {
+        // absolute deadlines keep the rate steady however long the transfers take
+        next.tv_nsec += period_ns;
+        while (next.tv_nsec >= 1000000000) {
+            next.tv_nsec -= 1000000000;
+            next.tv_sec++;
+        }
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) == EINTR);
+
+        // a failed transfer drops the block rather than publishing a wrong average
+        if (!sample(sums)) {
+            sums[0] = sums[1] = 0;
+            count = 0;
+            continue;
+        }
+
+        if (++count < oversample) continue;
+
+        publish(sums);
+        sums[0] = sums[1] = 0;
+        count = 0;
+    }
+}
@@ -0,0 +1,112 @@
+#pragma once
+#include "CBackend.h"
+#include <stdint.h>
+#include <thread>
+#include <atomic>
+
+/**
+*
+* @brief Samples both channels of the MCP3002 ADC in the background
+*
+* The SPI handle is opened once and a background thread reads channel 0 and
+* channel 1 back to back at a fixed rate. Every oversample pairs of readings are
+* averaged and published as one 64-bit snapshot, so readers always see both
+* channels from the same block, never wait and never touch the SPI bus.
+*
+*/
+class CAdcSampler {
+public:
+	/** @brief CAdcSampler constructor
+	*
+	* @param gpio The backend the SPI bus is driven through
+	* @return nothing to return
+	*/
+	CAdcSampler(CBackend& gpio);
+
+	/** @brief CAdcSampler destructor. Stops the thread and closes the SPI handle
+	*
+	* @return nothing to return
+	*/
+	~CAdcSampler();
+
+	/** @brief Opens the SPI bus, takes the first block of readings and starts the sampler thread.
+	* Restarts the sampler if it is already running
+	*
+	* @param rate_hz Pairs of readings per second. Capped at what the SPI clock allows
+	* @param oversample Pairs of readings averaged into each published value
+	* @param baud SPI clock in Hz. The MCP3002 runs up to 1.2 MHz at 2.7 V and 3.2 MHz at 5 V
+	* @return Returns a bool. (True --> Sampling) (False --> The SPI bus could not be opened or read)
+	*/
+	bool start(int rate_hz = 1000, int oversample = 8, int baud = 1000000);
+
+	/** @brief Stops the sampler thread and closes the SPI handle
+	*
+	* @return nothing to return
+	*/
+	void stop();
+
+	/** @brief Slows sampling right down while the forklift is idle, or goes back to the start rate
+	*
+	* @param idle True to sample 10 times a second, false for the rate given to start
+	* @return nothing to return
+	*/
+	void set_idle(bool idle);
+
+	/** @brief Gets the latest averaged reading of a channel, rounded to a whole count
+	*
+	* @param channel 0 or 1
+	* @param result The reading, 0 to 1023
+	* @return Returns a bool. (True --> Reading stored) (False --> Invalid channel or not sampling)
+	*/
+	bool read(int channel, int& result) const;
+
+	/** @brief Gets the latest averaged reading of a channel with the extra resolution from averaging
+	*
+	* @param channel 0 or 1
+	* @return Returns the reading in counts, 0 to 1023. -1 if the channel is invalid or not sampling
+	*/
+	double value(int channel) const;
+
+	/** @brief Gets the number of blocks published since start
+	*
+	* @return Returns the block count
+	*/
+	unsigned long blocks() const;
+
+	/** @brief Gets the sampling rate in use, after capping. Lower while idle
+	*
+	* @return Returns the rate in pairs of readings per second
+	*/
+	int rate() const;
+
+private:
+	/** @brief Reads both channels once
+	*
+	* @param counts The readings, added to what is already there
+	* @return Returns a bool. (True --> Both channels read) (False --> A transfer failed)
+	*/
+	bool sample(int counts[2]);
+
+	/** @brief Averages a block of readings and publishes it
+	*
+	* @param sums Sum of the readings of each channel
+	* @return nothing to return
+	*/
+	void publish(const int sums[2]);
+
+	/** @brief Runs on sampler and reads blocks until stopped
+	*
+	* @return nothing to return
+	*/
+	void sample_loop();
+
+    CBackend& gpio;
+    int handle;
+    std::atomic<int> period_ns; // read by the sampler before every reading
+    int active_period_ns;
+    int oversample;
+    std::thread sampler;
+    std::atomic<bool> running;
+    std::atomic<uint64_t> snapshot; // channel 0 and 1 in 1/256 counts (24 bits each), block count in the top 16 bits
+    std::atomic<unsigned long> published;
+};
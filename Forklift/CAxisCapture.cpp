@@ -0,0 +1,186 @@
+#include "CAxisCapture.h"
+#include <stdio.h>
+#include <string.h>
+
+using namespace std;
+
+static const char MAGIC[4] = {'F', 'K', 'L', 'A'};
+static const uint16_t VERSION = 1;
+
+static_assert(sizeof(CAxisCapture::file_header) == 12, "file_header layout is part of the file format");
+
+static void put_varint(vector<uint8_t>& out, uint32_t v) {
+    while (v >= 0x80) {
+        out.push_back((uint8_t)(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((uint8_t)v);
+}
+
+static bool get_varint(const vector<uint8_t>& in, size_t& pos, uint32_t& v) {
+    v = 0;
+
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (pos >= in.size()) return false;
+
+        uint8_t b = in[pos++];
+        v |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return true;
+    }
+
+    return false;
+}
+
+// small deltas either way become small unsigned numbers: 0, -1, 1, -2 ... -> 0, 1, 2, 3 ...
+static uint32_t zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v) {
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+CAxisCapture::CAxisCapture() {
+    axes = 0;
+    period_us = 0;
+    last_tick = 0;
+    frame_count = 0;
+    capturing = false;
+    memset(last, 0, sizeof(last));
+}
+
+bool CAxisCapture::open(const string& path, int axes, uint32_t period_us, const int16_t* values) {
+    if (axes <= 0 || axes > MAX_AXES || period_us == 0) return false;
+
+    this->path = path;
+    this->axes = axes;
+    this->period_us = period_us;
+    data.clear();
+    frame_count = 0;
+    last_tick = 0;
+    capturing = true;
+
+    // the first frame has every axis, so playback starts from the same stick positions
+    memset(last, 0, sizeof(last));
+    put_varint(data, 0);
+    data.push_back((uint8_t)((1 << axes) - 1));
+    for (int a = 0; a < axes; a++) {
+        put_varint(data, zigzag(values[a]));
+        last[a] = values[a];
+    }
+    frame_count++;
+
+    return true;
+}
+
+bool CAxisCapture::is_open() const {
+    return capturing;
+}
+
+void CAxisCapture::add(uint32_t tick, const int16_t* values, const vector<uint8_t>& buttons) {
+    if (!capturing || tick < last_tick) return;
+
+    uint8_t changed = 0;
+    for (int a = 0; a < axes; a++) {
+        if (values[a] != last[a]) changed |= 1 << a;
+    }
+
+    if (changed == 0 && buttons.empty()) return;
+
+    put_varint(data, tick - last_tick);
+    data.push_back(changed | (buttons.empty() ? 0 : 0x80));
+
+    for (int a = 0; a < axes; a++) {
+        if (!(changed & (1 << a))) continue;
+        put_varint(data, zigzag((int32_t)values[a] - last[a]));
+        last[a] = values[a];
+    }
+
+    if (!buttons.empty()) {
+        put_varint(data, buttons.size());
+        data.insert(data.end(), buttons.begin(), buttons.end());
+    }
+
+    last_tick = tick;
+    frame_count++;
+}
+
+bool CAxisCapture::close() {
+    if (!capturing) return false;
+    capturing = false;
+
+    FILE* out = fopen(path.c_str(), "wb");
+    if (out == NULL) return false;
+
+    file_header header;
+    memcpy(header.magic, MAGIC, 4);
+    header.version = VERSION;
+    header.axes = axes;
+    header.reserved = 0;
+    header.period_us = period_us;
+
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    if (!data.empty()) ok &= fwrite(&data[0], 1, data.size(), out) == data.size();
+
+    return fclose(out) == 0 && ok;
+}
+
+unsigned long CAxisCapture::frames() const {
+    return frame_count;
+}
+
+size_t CAxisCapture::bytes() const {
+    return data.size();
+}
+
+bool CAxisCapture::load(const string& path, vector<frame>& frames, uint32_t& period_us) {
+    frames.clear();
+
+    FILE* in = fopen(path.c_str(), "rb");
+    if (in == NULL) return false;
+
+    file_header header;
+    bool ok = fread(&header, sizeof(header), 1, in) == 1 && memcmp(header.magic, MAGIC, 4) == 0
+              && header.version == VERSION && header.axes > 0 && header.axes <= MAX_AXES && header.period_us > 0;
+
+    vector<uint8_t> data;
+    uint8_t buffer[4096];
+    size_t n;
+    while (ok && (n = fread(buffer, 1, sizeof(buffer), in)) > 0) data.insert(data.end(), buffer, buffer + n);
+    fclose(in);
+
+    if (!ok) return false;
+    period_us = header.period_us;
+
+    frame f;
+    f.tick = 0;
+    memset(f.values, 0, sizeof(f.values));
+
+    size_t pos = 0;
+    while (pos < data.size()) {
+        uint32_t gap, value;
+        if (!get_varint(data, pos, gap) || pos >= data.size()) return false;
+
+        uint8_t flags = data[pos++];
+        f.tick += gap;
+        f.changed = flags & 0x7F;
+        f.buttons.clear();
+
+        for (int a = 0; a < header.axes; a++) {
+            if (!(f.changed & (1 << a))) continue;
+            if (!get_varint(data, pos, value)) return false;
+            f.values[a] = (int16_t)(f.values[a] + unzigzag(value));
+        }
+
+        if (flags & 0x80) {
+            uint32_t count;
+            if (!get_varint(data, pos, count) || pos + count > data.size()) return false;
+            f.buttons.assign(data.begin() + pos, data.begin() + pos + count);
+            pos += count;
+        }
+
+        frames.push_back(f);
+    }
+
+    return true;
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+/**
+*
+* @brief Captures raw controller axis values and button presses, delta and varint compressed
+*
+* A capture is a file_header followed by one frame for each control tick where
+* something changed. A frame is the varint number of ticks since the previous
+* frame, a byte with one bit per changed axis (bit 7 set if buttons follow), a
+* zigzag varint delta for each changed axis and, if there are any, a varint
+* button count and the buttons. A stick at rest costs nothing and a moving stick
+* costs a few bytes a tick.
+*
+* Frames are built in memory and written by close, so capturing never waits on
+* the file system.
+*
+*/
+class CAxisCapture {
+public:
+	/**
+	* @brief most axes a capture can hold
+	*/
+	enum{MAX_AXES = 7};
+
+	/**
+	* @brief one control tick of input
+	*/
+	struct frame {
+		uint32_t tick;                // control ticks since the capture started
+		uint8_t changed;              // bit per axis whose value is new in this frame
+		int16_t values[MAX_AXES];     // value of every axis, changed or not
+		std::vector<uint8_t> buttons; // buttons pressed during the tick, in order
+	};
+
+	/**
+	* @brief start of every capture file
+	*/
+	struct file_header {
+		char magic[4];      // "FKLA"
+		uint16_t version;
+		uint8_t axes;
+		uint8_t reserved;
+		uint32_t period_us; // length of a tick
+	};
+
+	/** @brief CAxisCapture constructor
+	*
+	* @return nothing to return
+	*/
+	CAxisCapture();
+
+	/** @brief Starts a capture. The first frame holds every axis
+	*
+	* @param path The file close writes
+	* @param axes Number of axes, up to MAX_AXES
+	* @param period_us Length of a tick in microseconds
+	* @param values Value of each axis when the capture starts
+	* @return Returns a bool. (True --> Capturing) (False --> Invalid axes or period)
+	*/
+	bool open(const std::string& path, int axes, uint32_t period_us, const int16_t* values);
+
+	/** @brief Checks if a capture is in progress
+	*
+	* @return Returns a bool. (True --> Capturing) (False --> Not capturing)
+	*/
+	bool is_open() const;
+
+	/** @brief Adds a tick of input. Nothing is stored for a tick where nothing changed
+	*
+	* @param tick Control ticks since open, must not go backwards
+	* @param values Value of each axis at the end of the tick
+	* @param buttons Buttons pressed during the tick
+	* @return nothing to return
+	*/
+	void add(uint32_t tick, const int16_t* values, const std::vector<uint8_t>& buttons);
+
+	/** @brief Writes the capture and ends it
+	*
+	* @return Returns a bool. (True --> File written) (False --> Not capturing or file could not be written)
+	*/
+	bool close();
+
+	/** @brief Gets the number of frames stored so far
+	*
+	* @return Returns the frame count
+	*/
+	unsigned long frames() const;
+
+	/** @brief Gets the size of the compressed frames so far
+	*
+	* @return Returns the size in bytes, not counting the header
+	*/
+	size_t bytes() const;
+
+	/** @brief Reads a capture
+	*
+	* @param path The file to read
+	* @param frames The frames, with the value of every axis filled in
+	* @param period_us Length of a tick in microseconds
+	* @return Returns a bool. (True --> File read) (False --> File missing, not a capture or cut short)
+	*/
+	static bool load(const std::string& path, std::vector<frame>& frames, uint32_t& period_us);
+
+private:
+    std::string path;
+    std::vector<uint8_t> data;
+    int axes;
+    uint32_t period_us;
+    uint32_t last_tick;
+    int16_t last[MAX_AXES];
+    unsigned long frame_count;
+    bool capturing;
+};
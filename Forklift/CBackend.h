@@ -0,0 +1,81 @@
+#pragma once
+
+/**
+*
+* @brief Interface to the GPIO, PWM and SPI hardware used by CControl
+*
+* Calls follow the pigpio API they replace: 0 or a positive value on
+* success, a negative value on failure. CPigpioBackend drives the Pi and
+* CSimBackend runs in-process so the control code can run on any Linux box.
+*
+*/
+class CBackend {
+public:
+	/**
+	* @brief pin modes. Match PI_INPUT and PI_OUTPUT
+	*/
+	enum mode{INPUT = 0, OUTPUT = 1};
+
+	virtual ~CBackend() {}
+
+	/** @brief Starts the hardware. Called once by CControl
+	*
+	* @return Returns a bool. (True --> Started) (False --> Failed to start)
+	*/
+	virtual bool initialise() = 0;
+
+	/** @brief Releases the hardware
+	*
+	* @return nothing to return
+	*/
+	virtual void terminate() = 0;
+
+	virtual int set_mode(int pin, int mode) = 0;
+	virtual int read(int pin) = 0;
+	virtual int write(int pin, int level) = 0;
+
+	/** @brief Lowers every pin set in the mask with one register write
+	*
+	* @param bits Mask of pins 0-31
+	* @return Returns 0 on success
+	*/
+	virtual int write_bits_clear(unsigned int bits) = 0;
+
+	/** @brief Raises every pin set in the mask with one register write
+	*
+	* @param bits Mask of pins 0-31
+	* @return Returns 0 on success
+	*/
+	virtual int write_bits_set(unsigned int bits) = 0;
+
+	virtual int pwm(int pin, int duty) = 0;
+	virtual int set_pwm_frequency(int pin, int frequency) = 0;
+	virtual int set_pwm_range(int pin, int range) = 0;
+
+	/** @brief Gets the number of duty steps DMA-timed PWM really has on a pin at its frequency, whatever range was set
+	*
+	* @param pin The BCM pin number
+	* @return Returns the real range, negative on error
+	*/
+	virtual int get_pwm_real_range(int pin) = 0;
+
+	/** @brief Drives a pin from the PWM peripheral instead of DMA-timed PWM. Only pins 12, 13, 18 and 19
+	*
+	* @param pin The BCM pin number
+	* @param frequency PWM frequency in Hz
+	* @param duty Duty cycle in millionths, 0 to 1000000
+	* @return Returns 0 on success
+	*/
+	virtual int hardware_pwm(int pin, int frequency, int duty) = 0;
+	virtual int servo(int pin, int pulse_us) = 0;
+
+	virtual int spi_open(int channel, int baud, int flags) = 0;
+	virtual int spi_xfer(int handle, char* tx, char* rx, int count) = 0;
+	virtual int spi_close(int handle) = 0;
+
+	/** @brief Prints anything the backend measured while running
+	*
+	* @return nothing to return
+	*/
+	virtual void print_summary() {}
+};
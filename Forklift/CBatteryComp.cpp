@@ -0,0 +1,122 @@
+#include "CBatteryComp.h"
+#include <iostream>
+#include <algorithm>
+#include <math.h>
+
+using namespace std;
+
+// time constant of the voltage filter. Long enough to ride out the drop when the wheels start
+static const double FILTER_S = 2.0;
+
+// below this there is no battery on the divider, or the ADC isn't running
+static const double MIN_VOLTS = 6.0;
+
+// gain change that gets logged
+static const double LOG_STEP = 0.02;
+
+// duties were chosen at 12 V. Speed follows volts times duty, so the gain is 12 / volts,
+// held at the ends so a flat pack doesn't ask for more than the drivers can give
+static const CBatteryComp::point DEFAULT_CURVE[] = {
+    {10.5, 1.14}, {11.0, 1.09}, {11.5, 1.04}, {12.0, 1.0}, {12.6, 0.95}, {13.0, 0.92},
+};
+
+CBatteryComp::CBatteryComp(CAdcSampler& adc, int channel, double divider, double reference) : adc(adc) {
+    this->channel = channel;
+    volts_per_count = reference * divider / 1023;
+    counts = -1;
+    logged_gain = 1;
+    gain_q12 = 4096;
+
+    stats.updates = 0;
+    stats.logged = 0;
+    stats.min_volts = 0;
+    stats.max_gain = 1;
+    stats.gain_sum = 0;
+
+    set_curve(vector<point>(DEFAULT_CURVE, DEFAULT_CURVE + sizeof(DEFAULT_CURVE) / sizeof(DEFAULT_CURVE[0])));
+}
+
+bool CBatteryComp::set_curve(const vector<point>& points) {
+    if (points.empty()) return false;
+
+    for (size_t i = 0; i < points.size(); i++) {
+        if (points[i].gain <= 0) return false;
+    }
+
+    vector<point> sorted(points);
+    sort(sorted.begin(), sorted.end(), [](const point& a, const point& b) { return a.volts < b.volts; });
+
+    // one entry per count, so a lookup never has to search or interpolate
+    size_t next = 0;
+    for (int c = 0; c < 1024; c++) {
+        double v = c * volts_per_count;
+        while (next < sorted.size() && sorted[next].volts < v) next++;
+
+        if (next == 0) table[c] = (float)sorted[0].gain;
+        else if (next == sorted.size()) table[c] = (float)sorted.back().gain;
+        else {
+            const point& a = sorted[next - 1];
+            const point& b = sorted[next];
+            table[c] = (float)(a.gain + (b.gain - a.gain) * (v - a.volts) / (b.volts - a.volts));
+        }
+    }
+
+    return true;
+}
+
+void CBatteryComp::update(double dt_s) {
+    double reading = adc.value(channel);
+
+    if (reading < 0 || reading * volts_per_count < MIN_VOLTS) {
+        // nothing to go on, drive as if the battery were at 12 V
+        counts = -1;
+        set_gain(1);
+        return;
+    }
+
+    // the first good reading starts the filter
+    if (counts < 0) counts = reading;
+    else counts += (reading - counts) * min(1.0, dt_s / FILTER_S);
+
+    double gain = table[min(1023, max(0, (int)lround(counts)))];
+    set_gain(gain);
+
+    stats.updates++;
+    stats.gain_sum += gain;
+    if (stats.min_volts == 0 || get_volts() < stats.min_volts) stats.min_volts = get_volts();
+    if (gain > stats.max_gain) stats.max_gain = gain;
+}
+
+void CBatteryComp::set_gain(double gain) {
+    gain_q12 = (int)lround(gain * 4096);
+
+    if (fabs(gain - logged_gain) < LOG_STEP) return;
+
+    logged_gain = gain;
+    stats.logged++;
+    if (counts < 0) cout << "No battery reading, wheel duties left as they are\n";
+    else cout << "Battery " << get_volts() << " V, wheel duty x" << gain << "\n";
+}
+
+int CBatteryComp::apply(int duty, int range) const {
+    return min(range, (int)(((long long)duty * gain_q12 + 2048) >> 12));
+}
+
+double CBatteryComp::get_volts() const {
+    return counts < 0 ? 0 : counts * volts_per_count;
+}
+
+double CBatteryComp::get_gain() const {
+    return gain_q12 / 4096.0;
+}
+
+void CBatteryComp::print_stats() const {
+    if (stats.updates == 0) {
+        cout << "Battery compensation: no battery reading, duties left as they are\n";
+        return;
+    }
+
+    cout << "Battery compensation: " << get_volts() << " V now, lowest " << stats.min_volts << " V, wheel duty x"
+         << stats.gain_sum / stats.updates << " on average, x" << stats.max_gain << " at most, " << stats.logged
+         << " changes logged\n";
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include "CAdcSampler.h"
+#include <stdint.h>
+#include <vector>
+#include <atomic>
+
+/**
+*
+* @brief Scales the wheel duty cycles up as the battery runs down
+*
+* A DC motor's speed follows the voltage it sees, which is the duty cycle
+* times the battery voltage. Every duty cycle in the program was chosen on a
+* full battery, so as the pack sags the same command moves the forklift less.
+* The battery is read through a divider on one ADC channel, filtered so it
+* follows the charge rather than every current spike, and a gain is looked up
+* for it. The lookup is a table with one entry per ADC count, built once from a
+* few (volts, gain) points, so applying it to a command is one multiply.
+*
+* update runs on the input thread, apply on any thread.
+*
+*/
+class CBatteryComp {
+public:
+	/**
+	* @brief one point of the gain curve
+	*/
+	struct point {
+		double volts;
+		double gain;  // duty multiplier at that voltage
+	};
+
+	/**
+	* @brief corrections applied since start, printed on exit
+	*/
+	struct battery_stats {
+		unsigned long updates;
+		unsigned long logged;  // times the gain moved far enough to be logged
+		double min_volts;
+		double max_gain;
+		double gain_sum;
+	};
+
+	/** @brief CBatteryComp constructor. Starts with the default curve for a 12 V pack
+	*
+	* @param adc The sampler the battery is read through
+	* @param channel ADC channel the divider is on
+	* @param divider Battery volts per volt at the ADC pin
+	* @param reference ADC reference voltage
+	* @return nothing to return
+	*/
+	CBatteryComp(CAdcSampler& adc, int channel = 1, double divider = 4.0, double reference = 3.3);
+
+	/** @brief Replaces the gain curve. Gains between points are interpolated, outside them held at the end points
+	*
+	* @param points The curve, in any order
+	* @return Returns a bool. (True --> Curve set) (False --> No points, or a gain that isn't positive)
+	*/
+	bool set_curve(const std::vector<point>& points);
+
+	/** @brief Reads the battery and updates the gain. Call at a steady rate
+	*
+	* @param dt_s Time since the last update in seconds
+	* @return nothing to return
+	*/
+	void update(double dt_s);
+
+	/** @brief Applies the gain to a PWM duty cycle
+	*
+	* @param duty Duty cycle
+	* @param range PWM range, the result is capped at it
+	* @return Returns the corrected duty cycle
+	*/
+	int apply(int duty, int range) const;
+
+	/** @brief Gets the filtered battery voltage
+	*
+	* @return Returns the voltage, 0 before the first good reading
+	*/
+	double get_volts() const;
+
+	/** @brief Gets the gain being applied
+	*
+	* @return Returns the gain, 1 without a good reading
+	*/
+	double get_gain() const;
+
+	/** @brief Prints the corrections applied since start
+	*
+	* @return nothing to return
+	*/
+	void print_stats() const;
+
+private:
+	/** @brief Sets the gain the motor thread applies, and logs it if it moved far enough
+	*
+	* @param gain The new gain
+	* @return nothing to return
+	*/
+	void set_gain(double gain);
+
+    CAdcSampler& adc;
+    int channel;
+    double volts_per_count;
+    float table[1024];  // gain for each ADC count
+    double counts;      // filtered reading, -1 before the first good one
+    double logged_gain;
+    std::atomic<int> gain_q12;  // gain in 1/4096, read by the motor thread
+    battery_stats stats;
+};
@@ -1,17 +1,444 @@
 #include "CControl.h"
-#include "pigpio.h"
+#include "CSimBackend.h"
+#include "CTrace.h"
+#ifndef FORKLIFT_NO_PIGPIO
+#include "CPigpioBackend.h"
+#endif
+#include <string.h>
 #include <sstream>
 #include <iostream>
 #include <math.h>
 #include <unistd.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
 
 #define CE0 8
 
 using namespace std;
 
-CControl::CControl() {servo_pos = 0;}
+CControl::CControl() {
+    const char* backend = getenv("FORKLIFT_BACKEND");
+    const char* log_path = getenv("FORKLIFT_SIM_LOG");
 
-CControl::~CControl() {gpioTerminate();}
+#ifdef FORKLIFT_NO_PIGPIO
+    backend = "sim";
+#endif
+
+    if (backend != NULL && strcmp(backend, "sim") == 0) {
+        gpio = new CSimBackend(log_path != NULL ? log_path : "");
+    } else {
+#ifndef FORKLIFT_NO_PIGPIO
+        // pigpio's sample clock and buffer can only be set before it starts
+        const char* sample_us = getenv("FORKLIFT_SAMPLE_US");
+        const char* buffer_ms = getenv("FORKLIFT_BUFFER_MS");
+        gpio = new CPigpioBackend(sample_us != NULL ? atoi(sample_us) : 10, buffer_ms != NULL ? atoi(buffer_ms) : 120);
+#endif
+    }
+
+    own_gpio = true;
+    init();
+}
+
+CControl::CControl(CBackend& backend) {
+    gpio = &backend;
+    own_gpio = false;
+    init();
+}
+
+void CControl::init() {
+    servo_pos = 0;
+    reset_stats();
+
+    for (int i = 0; i < 54; i++) pin_mode[i] = -1;
+
+    pwm_frequency = 0;
+    pwm_range = 255;
+    pwm_steps = 255;
+    for (int i = 0; i < 4; i++) pwm_duty[i] = -1;
+
+    shadow_level = 0;
+    shadow_known = 0;
+    pending_set = 0;
+    pending_clear = 0;
+    update_depth = 0;
+
+    int step_pins[2] = {STEPR, STEPL};
+    int dir_pins[2] = {DIRR, DIRL};
+    int en_pins[2] = {ENR, ENL};
+
+    for (int i = 0; i < 2; i++) {
+        forks[i].step_pin = step_pins[i];
+        forks[i].dir_pin = dir_pins[i];
+        forks[i].en_pin = en_pins[i];
+        forks[i].dir = 1;
+        forks[i].start_ns = 0;
+        forks[i].pending = false;
+        forks[i].done = 0;
+        forks[i].position = 0;
+        forks[i].busy = false;
+        forks[i].cancel = false;
+    }
+
+    stepper_quit = false;
+    stepper_writes = 0;
+
+    // the backend is started once for the lifetime of the program
+    stats.initialises++;
+    if (!gpio->initialise()) {
+        cout << "Initialization Error: GPIO backend could not be started\n";
+        exit(1);
+    }
+
+    stepper_thread = thread(&CControl::stepper_loop, this);
+
+    // a frequency the DMA channels have at pigpio's 5 and 10 us sample clocks
+    configure_pwm(800, 1000);
+
+    // the ADC is sampled in the background from now on, analog reads only copy the latest values
+    adc = new CAdcSampler(*gpio);
+    if (!adc->start()) cout << "ADC sampler could not be started, analog reads will fail\n";
+}
+
+CControl::~CControl() {
+    {
+        lock_guard<mutex> lock(stepper_mutex);
+        stepper_quit = true;
+    }
+    stepper_cv.notify_all();
+    stepper_thread.join();
+
+    delete adc;
+    gpio->terminate();
+    if (own_gpio) delete gpio;
+}
+
+CBackend& CControl::get_backend() {
+    return *gpio;
+}
+
+CAdcSampler& CControl::get_adc() {
+    return *adc;
+}
+
+void CControl::set_idle(bool idle) {
+    adc->set_idle(idle);
+}
+
+// drive PWM channel (0 -> A front, 1 -> B front, 2 -> A back, 3 -> B back) to pin
+static int pwm_pin(int channel) {
+    if (channel == 1) return PWMBF;
+    if (channel == 2) return PWMAB;
+    if (channel == 3) return PWMBB;
+    return PWMAF;
+}
+
+// pins wired to the PWM peripheral
+static bool hardware_pwm_pin(int pin) {
+    return pin == 12 || pin == 13 || pin == 18 || pin == 19;
+}
+
+bool CControl::configure_pwm(int frequency, int range) {
+    if (frequency <= 0 || range < 25 || range > 40000) return false;
+
+    pwm_frequency = frequency;
+    pwm_range = range;
+    pwm_steps = range;
+    bool ok = true;
+
+    for (int channel = 0; channel < 4; channel++) {
+        int pin = pwm_pin(channel);
+        pwm_duty[channel] = -1;
+
+        // hardware PWM takes its frequency with each duty, the rest are set up here
+        if (hardware_pwm_pin(pin)) continue;
+
+        ok &= set_mode(pin, CBackend::OUTPUT);
+        ok &= gpio->set_pwm_frequency(pin, frequency) >= 0;
+        ok &= gpio->set_pwm_range(pin, range) >= 0;
+
+        // DMA PWM has one step per sample in a period whatever range it is given, so the
+        // wheels on these pins may have far fewer duty steps than the hardware channels
+        int real = gpio->get_pwm_real_range(pin);
+        ok &= real > 0;
+        if (real > 0 && real < pwm_steps) pwm_steps = real;
+        stats.io_calls += 3;
+    }
+
+    return ok;
+}
+
+int CControl::get_pwm_range() const {
+    return pwm_range;
+}
+
+int CControl::get_pwm_steps() const {
+    return pwm_steps;
+}
+
+bool CControl::set_mode(int pin, int mode) {
+    if (pin < 0 || pin >= 54) return false;
+
+    if (pin_mode[pin] == mode) {
+        stats.mode_skips++;
+        return true;
+    }
+
+    stats.mode_sets++;
+    if (gpio->set_mode(pin, mode) != 0) {
+        pin_mode[pin] = -1;
+        return false;
+    }
+
+    pin_mode[pin] = mode;
+    return true;
+}
+
+void CControl::write_pin(int pin, int level) {
+    gpio->write(pin, level);
+    TRACE_WRITE_DONE();
+    stats.io_calls++;
+
+    if (pin < 32) {
+        unsigned int bit = 1u << pin;
+        shadow_known |= bit;
+        if (level) shadow_level |= bit;
+        else shadow_level &= ~bit;
+    }
+}
+
+// CLOCK_MONOTONIC time in nanoseconds
+static long long now_ns() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+bool CControl::start_stepper(int channel, int steps, int dir, int step_us) {
+    if (steps < 0 || step_us < 2) return false;
+
+    vector<unsigned int> times(steps);
+    for (int i = 0; i < steps; i++) times[i] = i * step_us;
+
+    return start_stepper_profile(channel, dir, times);
+}
+
+bool CControl::start_stepper_profile(int channel, int dir, const vector<unsigned int>& step_times, long long start_ns) {
+    if (channel < 0 || channel > 1) return false;
+
+    stepper& s = forks[channel];
+
+    // modes are set here so stepper_loop only ever writes levels
+    set_mode(s.step_pin, CBackend::OUTPUT);
+    set_mode(s.dir_pin, CBackend::OUTPUT);
+    set_mode(s.en_pin, CBackend::OUTPUT);
+
+    {
+        lock_guard<mutex> lock(stepper_mutex);
+        s.dir = dir;
+        s.times = step_times;
+        s.start_ns = start_ns;
+        s.done = 0;
+        s.cancel = false;
+        s.busy = true;
+        s.pending = true;
+    }
+    stepper_cv.notify_all();
+
+    return true;
+}
+
+bool CControl::stepper_busy(int channel) const {
+    if (channel < 0 || channel > 1) return false;
+    return forks[channel].busy;
+}
+
+int CControl::stepper_progress(int channel) const {
+    if (channel < 0 || channel > 1) return 0;
+    return forks[channel].done;
+}
+
+int CControl::stepper_position(int channel) const {
+    if (channel < 0 || channel > 1) return 0;
+    return forks[channel].position;
+}
+
+void CControl::stop_stepper(int channel) {
+    if (channel < 0 || channel > 1) return;
+    forks[channel].cancel = true;
+}
+
+void CControl::wait_stepper(int channel) {
+    if (channel < 0 || channel > 1) return;
+
+    unique_lock<mutex> lock(stepper_mutex);
+    while (forks[channel].busy) stepper_done_cv.wait(lock);
+}
+
+void CControl::stepper_loop() {
+    // run ahead of the SDL thread if we're allowed to, the step timing doesn't need it otherwise
+    sched_param param;
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO) / 2;
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+
+    bool active[2] = {false, false};
+    bool high[2] = {false, false};
+    vector<unsigned int> times[2];
+    size_t next_step[2] = {0, 0};
+    long long start[2];
+    long long next[2]; // time of the next edge on each fork
+
+    unique_lock<mutex> lock(stepper_mutex);
+
+    while (!stepper_quit) {
+        for (int c = 0; c < 2; c++) {
+            if (!forks[c].pending) continue;
+            forks[c].pending = false;
+            forks[c].done = 0;
+            times[c].swap(forks[c].times);
+
+            if (high[c]) gpio->write(forks[c].step_pin, 0);
+            gpio->write(forks[c].dir_pin, forks[c].dir);
+            gpio->write(forks[c].en_pin, 0);
+            stepper_writes += high[c] ? 3 : 2;
+
+            high[c] = false;
+            active[c] = true;
+            next_step[c] = 0;
+            start[c] = forks[c].start_ns != 0 ? forks[c].start_ns : now_ns();
+            next[c] = times[c].empty() ? start[c] : start[c] + times[c][0] * 1000LL;
+        }
+
+        if (!active[0] && !active[1]) {
+            stepper_cv.wait(lock);
+            continue;
+        }
+
+        // the next edge is on whichever fork is due first, both forks can step at the same time
+        int c = (active[0] && (!active[1] || next[0] <= next[1])) ? 0 : 1;
+        stepper& s = forks[c];
+        size_t steps = times[c].size();
+
+        lock.unlock();
+
+        // deadlines are absolute so late wakeups don't add up over a move
+        timespec deadline;
+        deadline.tv_sec = next[c] / 1000000000LL;
+        deadline.tv_nsec = next[c] % 1000000000LL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+
+        bool finished = s.cancel || (!high[c] && next_step[c] >= steps);
+
+        if (!finished) {
+            high[c] = !high[c];
+            gpio->write(s.step_pin, high[c]);
+            stepper_writes++;
+
+            size_t k = next_step[c];
+            if (high[c]) {
+                // the driver steps on the rising edge, stay high for half the gap to the next step
+                s.done++;
+                s.position += s.dir ? 1 : -1;
+
+                long long gap_us = 1000;
+                if (k + 1 < steps) gap_us = times[c][k + 1] - times[c][k];
+                else if (k > 0) gap_us = times[c][k] - times[c][k - 1];
+                next[c] += gap_us * 500;
+            } else {
+                next_step[c] = ++k;
+                if (k < steps) next[c] = start[c] + times[c][k] * 1000LL;
+            }
+        }
+        lock.lock();
+
+        if (finished && !s.pending) {
+            if (high[c]) gpio->write(s.step_pin, 0);
+            gpio->write(s.en_pin, 1);
+            stepper_writes += high[c] ? 2 : 1;
+
+            high[c] = false;
+            active[c] = false;
+            s.busy = false;
+            stepper_done_cv.notify_all();
+        }
+    }
+
+    for (int c = 0; c < 2; c++) {
+        if (!active[c]) continue;
+        gpio->write(forks[c].step_pin, 0);
+        gpio->write(forks[c].en_pin, 1);
+        forks[c].busy = false;
+    }
+    stepper_done_cv.notify_all();
+}
+
+void CControl::begin_update() {
+    update_depth++;
+}
+
+bool CControl::commit_update() {
+    if (update_depth == 0) return true;
+    if (--update_depth > 0) return true;
+
+    // only send the pins whose level would actually change
+    unsigned int clear = pending_clear & ~(shadow_known & ~shadow_level);
+    unsigned int set = pending_set & ~(shadow_known & shadow_level);
+    pending_clear = 0;
+    pending_set = 0;
+
+    bool ok = true;
+
+    // lower pins first so a direction change passes through stop instead of both inputs high
+    if (clear) {
+        ok &= gpio->write_bits_clear(clear) == 0;
+        stats.bank_writes++;
+        stats.io_calls++;
+    }
+
+    if (set) {
+        ok &= gpio->write_bits_set(set) == 0;
+        stats.bank_writes++;
+        stats.io_calls++;
+    }
+
+    if (clear || set) TRACE_WRITE_DONE();
+
+    shadow_known |= clear | set;
+    shadow_level = (shadow_level & ~clear) | set;
+
+    return ok;
+}
+
+CControl::call_stats CControl::get_stats() const {
+    call_stats result = stats;
+    result.io_calls += stepper_writes;
+    return result;
+}
+
+void CControl::reset_stats() {
+    stats.requests = 0;
+    stats.initialises = 0;
+    stats.mode_sets = 0;
+    stats.mode_skips = 0;
+    stats.io_calls = 0;
+    stats.write_skips = 0;
+    stats.bank_writes = 0;
+    stepper_writes = 0;
+}
+
+void CControl::print_stats() const {
+    call_stats stats = get_stats();
+    unsigned long calls = stats.initialises + stats.mode_sets + stats.io_calls;
+
+    cout << "GPIO requests: " << stats.requests << "\n";
+    cout << "GPIO calls: " << calls << " (init " << stats.initialises << ", mode " << stats.mode_sets
+         << ", io " << stats.io_calls << "), mode sets skipped: " << stats.mode_skips << "\n";
+    cout << "Writes skipped: " << stats.write_skips << ", bank writes: " << stats.bank_writes << "\n";
+    if (stats.requests > 0) cout << "GPIO calls per request: " << (double)calls / stats.requests << "\n";
+
+    cout << "ADC blocks sampled: " << adc->blocks() << " at " << adc->rate() << " readings/s per channel\n";
+    gpio->print_summary();
+}
 
 float CControl::get_analog(int channel, int n, int& result) {
     get_data(ANALOG, channel, result);
@@ -20,27 +447,16 @@ float CControl::get_analog(int channel, int n, int& result) {
 }
 
 bool CControl::get_data(int type, int channel, int& result) {
-    if (gpioInitialise() < 0) {
-        gpioTerminate();
-        return false;
-    }
-
+    stats.requests++;
 
     if (type == ANALOG) {
-        unsigned char inBuf[3];
-        char cmd[] = {1, channel == 0 ? 0b10000000 : 0b10010000, 0}; // 0b1XXX0000 where XXX is the channel
-
-        int handle = spiOpen(0, 200000, 3); // Mode 0, 200kHz
-
-        spiXfer(handle, cmd, (char*) inBuf, 3); // Transfer 3 bytes
-        result = ((inBuf[1] & 3) << 8) | inBuf[2]; // Format 10 bits
-
-        spiClose(handle);
+        if (!adc->read(channel, result)) return false;
     }
 
     if (type == DIGITAL) {
-        gpioSetMode(channel, PI_INPUT);
-        result = gpioRead(channel);
+        if (!set_mode(channel, CBackend::INPUT)) return false;
+        result = gpio->read(channel);
+        stats.io_calls++;
     }
 
     if (type == SERVO) {
@@ -52,68 +468,82 @@ bool CControl::get_data(int type, int channel, int& result) {
 
 
 bool CControl::set_data(int type, int channel, int val, int dir) {
-    if (gpioInitialise() < 0) return false;
-    if (channel != -1) gpioSetMode(channel, PI_OUTPUT);
+    TRACE_SET_DATA();
+    stats.requests++;
 
     if (type == DIGITAL) {
-        gpioWrite(channel, val);
+        if (!set_mode(channel, CBackend::OUTPUT)) return false;
+
+        if (channel < 32) {
+            unsigned int bit = 1u << channel;
+
+            if (update_depth > 0) {
+                // held until commit_update, the latest level for a pin wins
+                if (val) {
+                    pending_set |= bit;
+                    pending_clear &= ~bit;
+                } else {
+                    pending_clear |= bit;
+                    pending_set &= ~bit;
+                }
+                return true;
+            }
+
+            if ((shadow_known & bit) && ((shadow_level & bit) != 0) == (val != 0)) {
+                stats.write_skips++;
+                return true;
+            }
+        }
+
+        write_pin(channel, val != 0);
     }
 
     if (type == SERVO) {
-        gpioServo(channel, (2.0/180 * val + 0.5) * 1000);
+        if (!set_mode(channel, CBackend::OUTPUT)) return false;
+        gpio->servo(channel, (2.0/180 * val + 0.5) * 1000);
+        TRACE_WRITE_DONE();
+        stats.io_calls++;
         servo_pos = val;
     }
 
     if (type == STEPPER) {
-        if (channel == 0) { // right fork
-         gpioSetMode(STEPR, PI_OUTPUT);
-         gpioSetMode(DIRR, PI_OUTPUT);
-         gpioSetMode(ENR, PI_OUTPUT);
-
-         gpioWrite(DIRR, dir);
-         gpioWrite(ENR, 0);
-
-         for (int i = 0; i < val; i++) { //val is # of steps
-            gpioWrite(STEPR, 1);
-            usleep(500);
-            gpioWrite(STEPR, 0);
-            usleep(500);
-         }
-
-         gpioWrite(ENR, 1);
-        }
-
-        if (channel == 1) { // left fork
-         gpioSetMode(STEPL, PI_OUTPUT);
-         gpioSetMode(DIRL, PI_OUTPUT);
-         gpioSetMode(ENL, PI_OUTPUT);
-
-         gpioWrite(DIRL, dir);
-         gpioWrite(ENL, 0);
-
-         for (int i = 0; i < val; i++) { //val is # of steps
-            gpioWrite(STEPL, 1);
-            usleep(500);
-            gpioWrite(STEPL, 0);
-            usleep(500);
-         }
-
-         gpioWrite(ENL, 1);
-        }
+        // channel 0 --> right fork, channel 1 --> left fork, val is # of steps
+        if (!start_stepper(channel, val, dir)) return false;
+        wait_stepper(channel);
     }
 
-    // channel --> 0 for A, 1 for B
-    // val --> duty cycle
-    // dir --> frequency
+    // channel --> 0 for A front, 1 for B front, 2 for A back, 3 for B back
+    // val --> duty cycle out of the range set by configure_pwm
     if (type == PWM) {
-        int pin = PWMAF;
-        if (channel == 1) pin = PWMBF;
-        else if (channel == 2) pin = PWMAB;
-        else if (channel == 3) pin = PWMBB;
+        if (channel < 0 || channel > 3) return false;
 
-        gpioSetMode(pin, PI_OUTPUT);
-        gpioSetPWMfrequency(pin, dir);
-        gpioPWM(pin, val);
+        int pin = pwm_pin(channel);
+        if (val < 0) val = 0;
+        if (val > pwm_range) val = pwm_range;
+
+        // every wheel gets the same levels, so the mixer's ratios between wheels hold on all four
+        val = (int)(((long long)val * pwm_steps + pwm_range / 2) / pwm_range * pwm_range / pwm_steps);
+
+        if (pwm_duty[channel] == val) {
+            stats.write_skips++;
+            return true;
+        }
+
+        int result;
+        if (hardware_pwm_pin(pin)) {
+            result = gpio->hardware_pwm(pin, pwm_frequency, (int)((long long)val * 1000000 / pwm_range));
+        } else {
+            set_mode(pin, CBackend::OUTPUT);
+            result = gpio->pwm(pin, val);
+        }
+        TRACE_WRITE_DONE();
+        stats.io_calls++;
+
+        if (result != 0) {
+            pwm_duty[channel] = -1;
+            return false;
+        }
+        pwm_duty[channel] = val;
     }
 
     return true;
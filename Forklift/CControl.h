@@ -1,5 +1,11 @@
 #pragma once
-#include "pigpio.h"
+#include "CBackend.h"
+#include "CAdcSampler.h"
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
 
 #define STEPR 27
 #define DIRR 17
@@ -48,13 +54,36 @@ public:
 	*/
 	enum type{DIGITAL = 0, ANALOG, SERVO, BUTTON, STEPPER, PWM};
 
-	/** @brief CControl constructor
+	/**
+	* @brief counts of calls made into the backend, used to measure the cost of each get_data/set_data
+	*/
+	struct call_stats {
+		unsigned long requests;    // calls to get_data/set_data
+		unsigned long initialises; // initialise
+		unsigned long mode_sets;   // set_mode
+		unsigned long mode_skips;  // set_mode calls avoided by the pin mode cache
+		unsigned long io_calls;    // every other backend call (read, write, PWM, SPI)
+		unsigned long write_skips; // digital writes dropped because the pin already had that level
+		unsigned long bank_writes; // write_bits_set/clear calls made by commit_update
+	};
+
+	/** @brief CControl constructor. Starts the backend once and exits if it can't be started.
+	* Uses pigpio unless the FORKLIFT_BACKEND environment variable is "sim" or the program
+	* was built with FORKLIFT_NO_PIGPIO. FORKLIFT_SIM_LOG names a file for the simulator's event log.
+	* FORKLIFT_SAMPLE_US and FORKLIFT_BUFFER_MS set pigpio's sample clock (default 10 us) and buffer (default 120 ms)
 	*
 	* @param comport none
 	* @return nothing to return
 	*/
 	CControl();
 
+	/** @brief CControl constructor using a backend owned by the caller
+	*
+	* @param backend The backend to drive. Must outlive the CControl
+	* @return nothing to return
+	*/
+	CControl(CBackend& backend);
+
 	/** @brief CControl destructor
 	*
 	* @param comport The com port to communicate through
@@ -62,7 +91,8 @@ public:
 	*/
 	~CControl();
 
-	/** @brief Gets the specified analog input from the microcontroller
+	/** @brief Gets the specified analog input from the microcontroller. Reads the latest
+	* averaged value from the ADC sampler, so it never waits on the SPI bus
 	*
 	* @param channel The channel which the input is on
 	* @param n Number of bit ADC (Ex. 12)
@@ -90,6 +120,207 @@ public:
 	*/
 	bool set_data(int type, int channel, int val, int dir = 1);
 
+	/** @brief Starts moving a fork stepper and returns immediately. The step train is generated
+	* by a real-time thread, a new move on a busy channel replaces the one in progress
+	*
+	* @param channel 0 for the right fork, 1 for the left fork
+	* @param steps Number of steps to move
+	* @param dir The direction to rotate. 1 for CW, 0 for CCW
+	* @param step_us Time between steps in microseconds. Defaults to 1000 (1 kHz)
+	* @return Returns a bool. (True --> Move started) (False --> Invalid channel or parameters)
+	*/
+	bool start_stepper(int channel, int steps, int dir, int step_us = 1000);
+
+	/** @brief Starts moving a fork stepper along a planned profile and returns immediately
+	*
+	* @param channel 0 for the right fork, 1 for the left fork
+	* @param dir The direction to rotate. 1 for CW, 0 for CCW
+	* @param step_times Time of each step in microseconds, measured from the start of the move
+	* @param start_ns CLOCK_MONOTONIC time in nanoseconds to start the move at. 0 starts it now.
+	* Giving both forks the same start time keeps them in lockstep
+	* @return Returns a bool. (True --> Move started) (False --> Invalid channel)
+	*/
+	bool start_stepper_profile(int channel, int dir, const std::vector<unsigned int>& step_times, long long start_ns = 0);
+
+	/** @brief Checks if a fork stepper is still moving
+	*
+	* @param channel 0 for the right fork, 1 for the left fork
+	* @return Returns a bool. (True --> Move in progress) (False --> Idle)
+	*/
+	bool stepper_busy(int channel) const;
+
+	/** @brief Gets the number of steps completed in the current or last move
+	*
+	* @param channel 0 for the right fork, 1 for the left fork
+	* @return Returns the completed step count
+	*/
+	int stepper_progress(int channel) const;
+
+	/** @brief Gets the absolute position of a fork stepper. Steps with dir 1 count up, dir 0 count down
+	*
+	* @param channel 0 for the right fork, 1 for the left fork
+	* @return Returns the position in steps since startup
+	*/
+	int stepper_position(int channel) const;
+
+	/** @brief Cancels the move in progress. The motor is disabled at the next step edge
+	*
+	* @param channel 0 for the right fork, 1 for the left fork
+	* @return nothing to return
+	*/
+	void stop_stepper(int channel);
+
+	/** @brief Blocks until a fork stepper has finished or been cancelled
+	*
+	* @param channel 0 for the right fork, 1 for the left fork
+	* @return nothing to return
+	*/
+	void wait_stepper(int channel);
+
+	/** @brief Starts grouping DIGITAL writes so they are sent together by commit_update.
+	* Calls can be nested, only the outermost commit_update writes to the pins
+	*
+	* @return nothing to return
+	*/
+	void begin_update();
+
+	/** @brief Sends the DIGITAL writes made since begin_update as one clear and one set bank write.
+	* Pins that already have the requested level are left out
+	*
+	* @return Returns a bool. (True --> Pins written or nothing to write) (False --> The backend rejected a bank write)
+	*/
+	bool commit_update();
+
+	/** @brief Gets the backend call counts gathered since startup or the last reset_stats
+	*
+	* @return Returns a copy of the counters
+	*/
+	call_stats get_stats() const;
+
+	/** @brief Clears the backend call counters
+	*
+	* @return nothing to return
+	*/
+	void reset_stats();
+
+	/** @brief Prints the backend call counters, the average number of backend calls per request
+	* and anything the backend measured
+	*
+	* @return nothing to return
+	*/
+	void print_stats() const;
+
+	/** @brief Gets the backend the pins are driven through
+	*
+	* @return Returns the backend
+	*/
+	CBackend& get_backend();
+
+	/** @brief Gets the background ADC sampler, to change its rate or read values with more resolution
+	*
+	* @return Returns the sampler
+	*/
+	CAdcSampler& get_adc();
+
+	/** @brief Cuts the background load while the forklift is idle, or restores it. The ADC is
+	* sampled 10 times a second while idle. Steppers and wheels are left as they are
+	*
+	* @param idle True to go idle, false to go back to full rate
+	* @return nothing to return
+	*/
+	void set_idle(bool idle);
+
+	/** @brief Sets the frequency and range of the four drive PWM channels. Meant to be called once at startup.
+	* Channels 0 and 1 (pins 18 and 13) use the hardware PWM peripheral at exactly this frequency. Channels 2
+	* and 3 use DMA-timed PWM at the nearest frequency the pigpio sample rate allows, which only has
+	* 1000000 / (sample_us * frequency) real duty steps: 125 at 800 Hz with the 10 us clock, 25 at 4 kHz.
+	* Duties on all four channels are rounded to the coarsest channel's steps, see get_pwm_steps
+	*
+	* @param frequency PWM frequency in Hz
+	* @param range Duty cycle that means fully on, 25 to 40000
+	* @return Returns a bool. (True --> Configured) (False --> Invalid frequency or range, or the backend rejected it)
+	*/
+	bool configure_pwm(int frequency, int range);
+
+	/** @brief Gets the PWM range, the duty cycle set_data(PWM, ...) takes as fully on
+	*
+	* @return Returns the range
+	*/
+	int get_pwm_range() const;
+
+	/** @brief Gets the number of distinct duty steps every drive channel produces. set_data(PWM, ...) rounds
+	* duties to multiples of get_pwm_range() / get_pwm_steps()
+	*
+	* @return Returns the steps, at most the range
+	*/
+	int get_pwm_steps() const;
+
 private:
+	/** @brief Sets up the caches and starts the backend and the stepper thread
+	*
+	* @return nothing to return
+	*/
+	void init();
+
+	/** @brief Sets the mode of a pin, skipping the call if the pin is already in that mode
+	*
+	* @param pin The BCM pin number
+	* @param mode CBackend::INPUT or CBackend::OUTPUT
+	* @return Returns a bool. (True --> Mode set or already set) (False --> The backend rejected the mode)
+	*/
+	bool set_mode(int pin, int mode);
+
+	/** @brief Writes a level to an output pin and records it in the shadow register
+	*
+	* @param pin The BCM pin number
+	* @param level 0 or 1
+	* @return nothing to return
+	*/
+	void write_pin(int pin, int level);
+
+	/** @brief Runs on stepper_thread and generates the step trains for both forks
+	*
+	* @return nothing to return
+	*/
+	void stepper_loop();
+
+	/**
+	* @brief a fork move handed to stepper_loop. The STEP, DIR and EN pins are only written by stepper_loop
+	*/
+	struct stepper {
+		int step_pin, dir_pin, en_pin;
+		int dir;
+		std::vector<unsigned int> times; // step times of the queued move in us
+		long long start_ns;
+		bool pending;              // move waiting to be picked up by stepper_loop
+		std::atomic<int> done;     // steps completed in the current move
+		std::atomic<int> position; // absolute position in steps
+		std::atomic<bool> busy;
+		std::atomic<bool> cancel;
+	};
+
+    CBackend* gpio;
+    bool own_gpio; // gpio was created by the constructor and is deleted with the CControl
+    CAdcSampler* adc;
+    int pwm_frequency;
+    int pwm_range;
+    int pwm_steps; // duty steps of the coarsest drive channel
+    int pwm_duty[4]; // last duty sent on each drive channel, -1 if unknown
     float servo_pos;
+    int pin_mode[54]; // last mode set on each BCM pin, -1 if unknown
+    call_stats stats;
+
+    unsigned int shadow_level; // last level written to each of pins 0-31
+    unsigned int shadow_known; // pins whose shadow_level has been written at least once
+    unsigned int pending_set;  // pins to raise on the next commit_update
+    unsigned int pending_clear; // pins to lower on the next commit_update
+    int update_depth;
+
+    stepper forks[2];
+    std::thread stepper_thread;
+    std::mutex stepper_mutex;
+    std::condition_variable stepper_cv;      // wakes stepper_loop when a move is queued
+    std::condition_variable stepper_done_cv; // wakes wait_stepper when a move ends
+    bool stepper_quit;
+    std::atomic<unsigned long> stepper_writes; // backend writes made by stepper_loop
 };
@@ -0,0 +1,179 @@
+#include "CForkPlanner.h"
+#include <math.h>
+#include <stdlib.h>
+#include <time.h>
+
+using namespace std;
+
+// dir that raises each fork. The motors face each other so the forks turn opposite ways
+static const int UP_DIR[2] = {0, 1};
+
+CForkPlanner::CForkPlanner(CControl& control) : control(control) {
+    start_rate = 800;
+    max_rate = 4000;
+    accel = 6000;
+    duration = 0;
+    zero();
+}
+
+void CForkPlanner::set_profile(double start_rate, double max_rate, double accel) {
+    if (start_rate <= 0 || max_rate < start_rate || accel <= 0) return;
+
+    this->start_rate = start_rate;
+    this->max_rate = max_rate;
+    this->accel = accel;
+}
+
+bool CForkPlanner::move_to(int fork, int height) {
+    if (fork < RIGHT_FORK || fork > BOTH_FORKS) return false;
+
+    bool moving[2] = {fork != LEFT_FORK, fork != RIGHT_FORK};
+
+    for (int i = 0; i < 2; i++) {
+        if (moving[i]) targets[i] = height;
+    }
+
+    return start(moving);
+}
+
+bool CForkPlanner::move_by(int fork, int steps) {
+    if (fork < RIGHT_FORK || fork > BOTH_FORKS) return false;
+
+    bool moving[2] = {fork != LEFT_FORK, fork != RIGHT_FORK};
+
+    for (int i = 0; i < 2; i++) {
+        if (moving[i]) targets[i] += steps;
+    }
+
+    return start(moving);
+}
+
+int CForkPlanner::height(int fork) const {
+    if (fork != RIGHT_FORK && fork != LEFT_FORK) return 0;
+
+    int steps = control.stepper_position(fork) - home[fork];
+    return UP_DIR[fork] ? steps : -steps;
+}
+
+int CForkPlanner::target(int fork) const {
+    if (fork != RIGHT_FORK && fork != LEFT_FORK) return 0;
+    return targets[fork];
+}
+
+int CForkPlanner::up_dir(int fork) const {
+    if (fork != RIGHT_FORK && fork != LEFT_FORK) return 1;
+    return UP_DIR[fork];
+}
+
+bool CForkPlanner::busy() const {
+    return control.stepper_busy(RIGHT_FORK) || control.stepper_busy(LEFT_FORK);
+}
+
+void CForkPlanner::wait() {
+    control.wait_stepper(RIGHT_FORK);
+    control.wait_stepper(LEFT_FORK);
+}
+
+void CForkPlanner::stop() {
+    control.stop_stepper(RIGHT_FORK);
+    control.stop_stepper(LEFT_FORK);
+    wait();
+
+    targets[RIGHT_FORK] = height(RIGHT_FORK);
+    targets[LEFT_FORK] = height(LEFT_FORK);
+}
+
+void CForkPlanner::zero() {
+    for (int i = 0; i < 2; i++) {
+        home[i] = control.stepper_position(i);
+        targets[i] = 0;
+    }
+}
+
+double CForkPlanner::last_duration() const {
+    return duration;
+}
+
+double CForkPlanner::move_duration(int steps) const {
+    if (steps <= 0) return 0;
+
+    vector<unsigned int> times;
+    return plan(steps, steps, times);
+}
+
+bool CForkPlanner::start(const bool moving[2]) {
+    int steps[2] = {0, 0};
+
+    for (int i = 0; i < 2; i++) {
+        if (!moving[i]) continue;
+
+        // a new target replaces the move in progress, so plan from where the fork actually stopped
+        if (control.stepper_busy(i)) {
+            control.stop_stepper(i);
+            control.wait_stepper(i);
+        }
+
+        steps[i] = targets[i] - height(i);
+    }
+
+    int longest = max(abs(steps[0]), abs(steps[1]));
+    if (longest == 0) return true;
+
+    // both forks get the same start time so their profiles line up
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long start_ns = now.tv_sec * 1000000000LL + now.tv_nsec + 2000000LL;
+
+    bool ok = true;
+    vector<unsigned int> times;
+
+    for (int i = 0; i < 2; i++) {
+        if (steps[i] == 0) continue;
+
+        duration = plan(abs(steps[i]), longest, times);
+        int dir = steps[i] > 0 ? UP_DIR[i] : 1 - UP_DIR[i];
+        ok &= control.start_stepper_profile(i, dir, times, start_ns);
+    }
+
+    return ok;
+}
+
+double CForkPlanner::plan(int steps, int longest, vector<unsigned int>& times) const {
+    // trapezoid for the longest move: ramp from start_rate to peak, cruise, ramp back down
+    double v0 = start_rate;
+    double peak = max_rate;
+    double ramp_dist = (peak * peak - v0 * v0) / (2 * accel);
+
+    if (2 * ramp_dist > longest) {
+        // too short to reach max_rate, the profile becomes a triangle
+        peak = sqrt(accel * longest + v0 * v0);
+        ramp_dist = longest / 2.0;
+    }
+
+    double ramp_time = (peak - v0) / accel;
+    double cruise_dist = longest - 2 * ramp_dist;
+    double total = 2 * ramp_time + cruise_dist / peak;
+
+    // a shorter move follows the same profile scaled down, so step k lands where
+    // the longest move would be at k * longest / steps
+    double scale = (double)longest / steps;
+
+    times.resize(steps);
+    for (int k = 0; k < steps; k++) {
+        double x = k * scale;
+        double t;
+
+        if (x <= ramp_dist) {
+            t = (sqrt(v0 * v0 + 2 * accel * x) - v0) / accel;
+        } else if (x <= ramp_dist + cruise_dist) {
+            t = ramp_time + (x - ramp_dist) / peak;
+        } else {
+            double left = longest - x;
+            t = total - (sqrt(v0 * v0 + 2 * accel * left) - v0) / accel;
+        }
+
+        times[k] = (unsigned int)(t * 1000000);
+    }
+
+    return total;
+}
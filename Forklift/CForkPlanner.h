@@ -0,0 +1,134 @@
+#pragma once
+#include "CControl.h"
+#include <vector>
+
+/**
+*
+* @brief Plans coordinated moves of the two fork steppers
+*
+* Keeps the height of each fork in steps above its home position and
+* drives both forks at once along trapezoidal velocity profiles. When both
+* forks move, their profiles are scaled to start and finish together, so forks
+* moving the same distance step in lockstep.
+*
+*/
+class CForkPlanner {
+public:
+	/**
+	* @brief forks that can be moved. Matches the stepper channels in CControl
+	*/
+	enum fork{RIGHT_FORK = 0, LEFT_FORK, BOTH_FORKS};
+
+	/** @brief CForkPlanner constructor. The current fork positions become height 0
+	*
+	* @param control The CControl that drives the steppers
+	* @return nothing to return
+	*/
+	CForkPlanner(CControl& control);
+
+	/** @brief Sets the velocity profile used for every move
+	*
+	* @param start_rate Step rate in steps/s the motors can start and stop at without stalling
+	* @param max_rate Peak step rate in steps/s
+	* @param accel Acceleration in steps/s^2
+	* @return nothing to return
+	*/
+	void set_profile(double start_rate, double max_rate, double accel);
+
+	/** @brief Moves a fork, or both forks, to an absolute height and returns immediately
+	*
+	* @param fork RIGHT_FORK, LEFT_FORK or BOTH_FORKS
+	* @param height Target height in steps above home
+	* @return Returns a bool. (True --> Move started) (False --> Invalid fork)
+	*/
+	bool move_to(int fork, int height);
+
+	/** @brief Moves a fork, or both forks, relative to their current targets and returns immediately
+	*
+	* @param fork RIGHT_FORK, LEFT_FORK or BOTH_FORKS
+	* @param steps Steps to move. Positive is up
+	* @return Returns a bool. (True --> Move started) (False --> Invalid fork)
+	*/
+	bool move_by(int fork, int steps);
+
+	/** @brief Gets the current height of a fork
+	*
+	* @param fork RIGHT_FORK or LEFT_FORK
+	* @return Returns the height in steps above home
+	*/
+	int height(int fork) const;
+
+	/** @brief Gets the height a fork is moving to, or resting at
+	*
+	* @param fork RIGHT_FORK or LEFT_FORK
+	* @return Returns the target height in steps above home
+	*/
+	int target(int fork) const;
+
+	/** @brief Gets the stepper direction that raises a fork
+	*
+	* @param fork RIGHT_FORK or LEFT_FORK
+	* @return Returns the dir value to pass to CControl
+	*/
+	int up_dir(int fork) const;
+
+	/** @brief Checks if either fork is moving
+	*
+	* @return Returns a bool. (True --> A fork is moving) (False --> Both forks idle)
+	*/
+	bool busy() const;
+
+	/** @brief Blocks until both forks have stopped
+	*
+	* @return nothing to return
+	*/
+	void wait();
+
+	/** @brief Cancels any move in progress. Targets are set to where the forks stop
+	*
+	* @return nothing to return
+	*/
+	void stop();
+
+	/** @brief Makes the current fork positions height 0
+	*
+	* @return nothing to return
+	*/
+	void zero();
+
+	/** @brief Gets the planned duration of the last move
+	*
+	* @return Returns the duration in seconds
+	*/
+	double last_duration() const;
+
+	/** @brief Works out how long a move takes with the current profile
+	*
+	* @param steps Steps the longest moving fork travels
+	* @return Returns the duration in seconds
+	*/
+	double move_duration(int steps) const;
+
+private:
+	/** @brief Plans and starts a move of the selected forks to their targets
+	*
+	* @param moving Which forks to move
+	* @return Returns a bool. (True --> Move started) (False --> A stepper rejected the move)
+	*/
+	bool start(const bool moving[2]);
+
+	/** @brief Builds the step times for a move, scaled so it takes as long as a longer move
+	*
+	* @param steps Steps this fork moves
+	* @param longest Steps the longest fork moves
+	* @param times The step times in microseconds
+	* @return Returns the duration of the move in seconds
+	*/
+	double plan(int steps, int longest, std::vector<unsigned int>& times) const;
+
+    CControl& control;
+    int home[2];    // stepper position at height 0
+    int targets[2];
+    double start_rate, max_rate, accel;
+    double duration;
+};
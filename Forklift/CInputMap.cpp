@@ -0,0 +1,194 @@
+#include "CInputMap.h"
+#include "CTurnPlanner.h"
+#include "CForkPlanner.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string.h>
+
+using namespace std;
+
+// the default tables are laid out in SDL's order
+static_assert(SDL_CONTROLLER_BUTTON_A == 0 && SDL_CONTROLLER_BUTTON_START == 6 && SDL_CONTROLLER_BUTTON_DPAD_RIGHT == 14
+              && SDL_CONTROLLER_BUTTON_MISC1 == 15, "SDL button order changed");
+static_assert(SDL_CONTROLLER_AXIS_LEFTX == 0 && SDL_CONTROLLER_AXIS_TRIGGERRIGHT == 5, "SDL axis order changed");
+static_assert((int)SDL_CONTROLLER_BUTTON_MAX <= (int)CInputMap::MAX_BUTTONS && (int)SDL_CONTROLLER_AXIS_MAX <= (int)CInputMap::MAX_AXES, "tables too small");
+
+static const int FINE_STEPS = 200;
+
+static constexpr CInputMap::binding DEFAULT_BUTTONS[CInputMap::MAX_BUTTONS] = {
+    {CInputMap::TURN, -1, CTurnPlanner::BACKWARD},                       // a
+    {CInputMap::TURN, -1, CTurnPlanner::RIGHT},                          // b
+    {CInputMap::TURN, -1, CTurnPlanner::LEFT},                           // x
+    {CInputMap::TURN, -1, CTurnPlanner::FORWARD},                        // y
+    {CInputMap::CAPTURE, -1, 0},                                         // back
+    {CInputMap::PLAY_BACK, -1, 0},                                       // guide
+    {CInputMap::RECORD, -1, 0},                                          // start
+    {CInputMap::FORKS_LEVEL, CForkPlanner::BOTH_FORKS, 1},               // leftstick
+    {CInputMap::FORKS_LEVEL, CForkPlanner::BOTH_FORKS, 1},               // rightstick
+    {CInputMap::FORKS_LEVEL, CForkPlanner::BOTH_FORKS, -1},              // leftshoulder
+    {CInputMap::FORKS_LEVEL, CForkPlanner::BOTH_FORKS, -1},              // rightshoulder
+    {CInputMap::FORKS_STEP, CForkPlanner::LEFT_FORK, FINE_STEPS},        // dpup
+    {CInputMap::FORKS_STEP, CForkPlanner::RIGHT_FORK, -FINE_STEPS},      // dpdown
+    {CInputMap::FORKS_STEP, CForkPlanner::LEFT_FORK, -FINE_STEPS},       // dpleft
+    {CInputMap::FORKS_STEP, CForkPlanner::RIGHT_FORK, FINE_STEPS},       // dpright
+    {CInputMap::PLAY_CAPTURE, -1, 0},                                    // misc1
+};
+
+static constexpr CInputMap::axis_binding DEFAULT_AXES[CInputMap::MAX_AXES] = {
+    {CInputMap::STRAFE, true, 140},          // leftx
+    {CInputMap::NO_MOTION, true, 0},         // lefty
+    {CInputMap::SPIN, true, 140},            // rightx
+    {CInputMap::NO_MOTION, true, 0},         // righty
+    {CInputMap::DRIVE_BACKWARD, false, 50},  // lefttrigger
+    {CInputMap::DRIVE_FORWARD, false, 50},   // righttrigger
+};
+
+static const CInputMap::binding UNBOUND = {CInputMap::NONE, -1, 0};
+static const CInputMap::axis_binding UNBOUND_AXIS = {CInputMap::NO_MOTION, true, 0};
+
+// names used in profile files, in enum order
+static const char* COMMAND_NAMES[CInputMap::COMMANDS] = {"none", "forks_level", "forks_step", "turn", "record", "play_back", "capture", "play_capture", "abort", "approach"};
+static const char* MOTION_NAMES[CInputMap::MOTIONS] = {"none", "forward", "backward", "strafe", "spin"};
+static const char* FORK_NAMES[3] = {"right", "left", "both"};
+static const char* HEADING_NAMES[4] = {"right", "forward", "left", "backward"};
+
+static int find_name(const char* const names[], int count, const string& name) {
+    for (int i = 0; i < count; i++) {
+        if (name == names[i]) return i;
+    }
+    return -1;
+}
+
+CInputMap::CInputMap() {
+    reset();
+}
+
+void CInputMap::reset() {
+    memcpy(buttons, DEFAULT_BUTTONS, sizeof(buttons));
+    memcpy(axes, DEFAULT_AXES, sizeof(axes));
+}
+
+bool CInputMap::load(const string& path) {
+    ifstream infile(path);
+    if (!infile) return false;
+
+    // read into copies so a bad line leaves the current profile as it was
+    binding new_buttons[MAX_BUTTONS];
+    axis_binding new_axes[MAX_AXES];
+    memcpy(new_buttons, buttons, sizeof(buttons));
+    memcpy(new_axes, axes, sizeof(axes));
+
+    string line;
+    int line_number = 0;
+
+    while (getline(infile, line)) {
+        line_number++;
+
+        istringstream fields(line);
+        string kind, name, what;
+        if (!(fields >> kind) || kind[0] == '#') continue;
+
+        bool ok = (bool)(fields >> name >> what);
+
+        if (ok && kind == "button") {
+            int b = SDL_GameControllerGetButtonFromString(name.c_str());
+            int c = find_name(COMMAND_NAMES, COMMANDS, what);
+            binding bound = {(uint8_t)c, -1, 0};
+            string fork, heading;
+            int value;
+
+            ok = b >= 0 && b < MAX_BUTTONS && c >= 0;
+
+            if (ok && (c == FORKS_LEVEL || c == FORKS_STEP)) {
+                ok = (bool)(fields >> fork >> value) && find_name(FORK_NAMES, 3, fork) >= 0;
+                bound.channel = (int8_t)find_name(FORK_NAMES, 3, fork);
+                bound.value = (int16_t)value;
+            } else if (ok && c == TURN) {
+                ok = (bool)(fields >> heading) && find_name(HEADING_NAMES, 4, heading) >= 0;
+                bound.value = (int16_t)find_name(HEADING_NAMES, 4, heading);
+            }
+
+            if (ok) new_buttons[b] = bound;
+        } else if (ok && kind == "axis") {
+            int a = SDL_GameControllerGetAxisFromString(name.c_str());
+            int m = find_name(MOTION_NAMES, MOTIONS, what);
+            int deadzone;
+
+            ok = a >= 0 && a < MAX_AXES && m >= 0 && (fields >> deadzone) && deadzone >= 0 && deadzone <= 200;
+            if (ok) {
+                new_axes[a].motion = (uint8_t)m;
+                new_axes[a].deadzone = (int16_t)deadzone;
+            }
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            cout << path << " line " << line_number << ": can't read \"" << line << "\"\n";
+            return false;
+        }
+    }
+
+    memcpy(buttons, new_buttons, sizeof(buttons));
+    memcpy(axes, new_axes, sizeof(axes));
+    return true;
+}
+
+const CInputMap::binding& CInputMap::button(int button) const {
+    if (button < 0 || button >= MAX_BUTTONS) return UNBOUND;
+    return buttons[button];
+}
+
+const CInputMap::axis_binding& CInputMap::axis(int axis) const {
+    if (axis < 0 || axis >= MAX_AXES) return UNBOUND_AXIS;
+    return axes[axis];
+}
+
+double CInputMap::scale(int axis, int value) const {
+    const axis_binding& a = this->axis(axis);
+    int dc;
+
+    if (a.centred) {
+        // map the value to -200->200 for a stick
+        dc = (int)((400.0 / 65535.0) * (value + 32768) - 200);
+        if (dc > 0 && dc < a.deadzone) dc = 0;
+        if (dc < 0 && dc > -a.deadzone) dc = 0;
+    } else {
+        // map the value to 0->200 for a trigger
+        dc = (int)((200.0 / 65535.0) * (value + 32768));
+        if (dc > 0 && dc < a.deadzone) dc = 0;
+        if (dc < 0) dc = 0;
+    }
+
+    return dc / 200.0;
+}
+
+int CInputMap::record_direction(int axis, int value) const {
+    const axis_binding& a = this->axis(axis);
+
+    // direction of each motion pushed positive and negative
+    static const int DIRECTIONS[MOTIONS][2] = {
+        {-2, -2},
+        {CTurnPlanner::FORWARD, CTurnPlanner::BACKWARD},
+        {CTurnPlanner::BACKWARD, CTurnPlanner::FORWARD},
+        {CTurnPlanner::RIGHT, CTurnPlanner::LEFT},
+        {-2, -2},
+    };
+
+    int dir = DIRECTIONS[a.motion][0];
+    if (dir == -2) return -2;
+
+    if (a.centred) {
+        if (value > 16384) return dir;
+        if (value < -16384) return DIRECTIONS[a.motion][1];
+        return -1;
+    }
+
+    return value > 0 ? dir : -1;
+}
+
+bool CInputMap::is_mode_button(int button) const {
+    int c = this->button(button).command;
+    return c == RECORD || c == PLAY_BACK || c == CAPTURE || c == PLAY_CAPTURE || c == ABORT || c == APPROACH;
+}
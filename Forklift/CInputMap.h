@@ -0,0 +1,118 @@
+#pragma once
+#include <SDL.h>
+#include <stdint.h>
+#include <string>
+
+/**
+*
+* @brief Flat tables that map controller buttons and axes to what they do
+*
+* Each button has a binding and each axis an axis_binding, indexed directly by
+* the SDL button or axis, so handling an event is one array read. The default
+* profile is a constexpr table built into the program. A profile file can
+* rebind any of them at startup, one binding per line:
+*
+*     button <name> <command> [fork] [value]
+*     axis <name> <motion> <deadzone>
+*
+* Names are the SDL game controller names (a, b, dpup, leftshoulder, leftx,
+* righttrigger ...). Blank lines and lines starting with # are skipped.
+*
+*/
+class CInputMap {
+public:
+	/**
+	* @brief size of the tables, more than any SDL version has buttons or axes
+	*/
+	enum{MAX_BUTTONS = 32, MAX_AXES = 8};
+
+	/**
+	* @brief what a button does
+	*/
+	enum command{NONE = 0, FORKS_LEVEL, FORKS_STEP, TURN, RECORD, PLAY_BACK, CAPTURE, PLAY_CAPTURE, ABORT, APPROACH, COMMANDS};
+
+	/**
+	* @brief what an axis drives. Also the index into the motion each axis asks for
+	*/
+	enum motion{NO_MOTION = 0, DRIVE_FORWARD, DRIVE_BACKWARD, STRAFE, SPIN, MOTIONS};
+
+	/**
+	* @brief one button
+	*/
+	struct binding {
+		uint8_t command; // command
+		int8_t channel;  // fork for FORKS_LEVEL and FORKS_STEP
+		int16_t value;   // levels, steps or the heading to TURN to
+	};
+
+	/**
+	* @brief one axis
+	*/
+	struct axis_binding {
+		uint8_t motion;   // motion
+		bool centred;     // sticks rest in the middle, triggers rest at the bottom
+		int16_t deadzone; // out of 200, smaller values count as 0
+	};
+
+	/** @brief CInputMap constructor. Starts with the default profile
+	*
+	* @return nothing to return
+	*/
+	CInputMap();
+
+	/** @brief Goes back to the default profile
+	*
+	* @return nothing to return
+	*/
+	void reset();
+
+	/** @brief Reads a profile file over the default profile. Nothing changes if the file has an error
+	*
+	* @param path The profile to read
+	* @return Returns a bool. (True --> Profile read) (False --> File missing or has an error)
+	*/
+	bool load(const std::string& path);
+
+	/** @brief Gets what a button does
+	*
+	* @param button The SDL button
+	* @return Returns the binding, command NONE if the button does nothing
+	*/
+	const binding& button(int button) const;
+
+	/** @brief Gets what an axis drives
+	*
+	* @param axis The SDL axis
+	* @return Returns the binding, motion NO_MOTION if the axis does nothing
+	*/
+	const axis_binding& axis(int axis) const;
+
+	/** @brief Converts a raw axis value to the motion it asks for
+	*
+	* @param axis The SDL axis
+	* @param value Raw value, -32768 to 32767
+	* @return Returns -1 to 1 for a centred axis and 0 to 1 otherwise, 0 inside the deadzone
+	*/
+	double scale(int axis, int value) const;
+
+	/** @brief Gets the drive direction a recording stores for an axis value. Recordings keep
+	* to whole directions, so sticks have to be pushed at least halfway
+	*
+	* @param axis The SDL axis
+	* @param value Raw value, -32768 to 32767
+	* @return Returns RIGHT, FORWARD, LEFT or BACKWARD as in CTurnPlanner, -1 if the axis is released
+	* and -2 if the axis doesn't drive in a direction that can be recorded
+	*/
+	int record_direction(int axis, int value) const;
+
+	/** @brief Checks if a button starts or stops recording, playing or an approach, or aborts a routine, which captures leave out
+	*
+	* @param button The SDL button
+	* @return Returns a bool. (True --> Mode button) (False --> Drives or moves the forks)
+	*/
+	bool is_mode_button(int button) const;
+
+private:
+    binding buttons[MAX_BUTTONS];
+    axis_binding axes[MAX_AXES];
+};
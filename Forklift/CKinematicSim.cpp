@@ -0,0 +1,222 @@
+#include "CKinematicSim.h"
+#include "CPlanOptimiser.h"
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+using namespace std;
+
+// which way each wheel's rollers push the chassis for forward, sideways to the right
+// and clockwise motion. The same layout CMixer mixes for
+static const double SIGNS[4][3] = {
+    {1,  1,  1},  // front left
+    {1, -1, -1},  // front right
+    {1, -1,  1},  // back left
+    {1,  1, -1},  // back right
+};
+
+// main configures the drive PWM with this range, the mixer's duties are out of it
+static const int PWM_RANGE = 1000;
+
+// play_action turns at the duty move_forklift defaults to
+static const int TURN_DUTY = 200;
+
+CKinematicSim::CKinematicSim(const CForkPlanner& forks, const model& m) : forks(forks), m(m) {}
+
+CKinematicSim::model CKinematicSim::default_model() {
+    model m;
+    m.wheel_radius = 0.03;
+    m.half_length = 0.075;
+    m.half_width = 0.085;
+    // chosen so a 950 ms quarter turn at duty 200 comes out at 90 degrees
+    m.max_wheel_speed = 11.25;
+    m.time_constant = 0.08;
+    for (int i = 0; i < 4; i++) m.wheel_scale[i] = 1;
+    m.dt = 0.001;
+    return m;
+}
+
+CKinematicSim::job CKinematicSim::default_job(const string& path) {
+    job j;
+    j.path = path;
+    j.turn_90_ms = 950;
+    j.turn_180_ms = 1875;
+    j.strafe_gain = 0.8;
+    j.optimise = false;
+    j.retime_turns = true;
+    return j;
+}
+
+CKinematicSim::result CKinematicSim::run(const job& j) const {
+    result failed = {false, 0, 0, 0, 0, 0, {0, 0}, 0};
+    vector<CRecorder::record> records;
+
+    if (!CRecorder::load(j.path, records)) return failed;
+
+    CTurnPlanner turns(j.turn_90_ms, j.turn_180_ms);
+
+    // recorded turns carry the durations they were recorded with
+    if (j.retime_turns) {
+        for (size_t i = 0; i < records.size(); i++) {
+            CRecorder::record& r = records[i];
+            double omega;
+            if (r.type == CRecorder::DC && r.facing != -1) r.duration_ns = turns.plan(r.facing, r.dir, omega) * 1000000LL;
+        }
+    }
+
+    CMixer mixer;
+    mixer.set_gain(2, CMixer::VY, j.strafe_gain);
+
+    vector<CPlayback::action> actions;
+    if (j.optimise) {
+        CPlanOptimiser optimiser(forks);
+        optimiser.compile(records, actions);
+    } else {
+        CPlayback(forks).compile(records, actions);
+    }
+
+    return simulate(actions, mixer, turns);
+}
+
+CKinematicSim::result CKinematicSim::simulate(const vector<CPlayback::action>& actions, const CMixer& mixer, const CTurnPlanner& turns) const {
+    result r = {true, 0, 0, 0, 0, 0, {0, 0}, 0};
+
+    double speed[4] = {0, 0, 0, 0};  // wheel speeds, rad/s
+    double command[4] = {0, 0, 0, 0};
+    double x = 0, y = 0, theta = 0, now = 0;
+    int facing = CTurnPlanner::FORWARD;
+
+    // a fork moves from one height to another between two times
+    double fork_from[2], fork_to[2], fork_start[2] = {0, 0}, fork_end[2] = {0, 0};
+    for (int f = 0; f < 2; f++) fork_from[f] = fork_to[f] = forks.target(f);
+
+    double alpha = 1 - exp(-m.dt / m.time_constant);
+    double track = m.half_length + m.half_width;
+
+    // integrates the chassis up to a time
+    auto advance = [&](double until) {
+        while (now < until) {
+            double h = min(m.dt, until - now);
+            double a = h == m.dt ? alpha : 1 - exp(-h / m.time_constant);
+            double v[3] = {0, 0, 0};
+
+            for (int w = 0; w < 4; w++) {
+                speed[w] += (command[w] - speed[w]) * a;
+                for (int k = 0; k < 3; k++) v[k] += SIGNS[w][k] * speed[w] * m.wheel_radius / 4;
+            }
+
+            // body frame is forward, right and clockwise, the pose is forward, left and anticlockwise
+            double forward = v[0], left = -v[1], spin = -v[2] / track;
+            x += (forward * cos(theta) - left * sin(theta)) * h;
+            y += (forward * sin(theta) + left * cos(theta)) * h;
+            theta += spin * h;
+            now += h;
+        }
+    };
+
+    auto set_wheels = [&](double vx, double vy, double omega, int duty_cycle) {
+        int duty[4];
+        mixer.mix(vx, vy, omega, (int)((long long)duty_cycle * PWM_RANGE / 255), duty);
+        for (int w = 0; w < 4; w++) command[w] = (double)duty[w] / PWM_RANGE * m.max_wheel_speed * m.wheel_scale[w];
+    };
+
+    auto fork_height = [&](int f) {
+        if (now >= fork_end[f]) return fork_to[f];
+        return fork_from[f] + (fork_to[f] - fork_from[f]) * (now - fork_start[f]) / (fork_end[f] - fork_start[f]);
+    };
+
+    for (size_t i = 0; i < actions.size(); i++) {
+        const CPlayback::action& a = actions[i];
+
+        // an action that runs late is carried out as soon as the one before it is done
+        advance(a.at_ns / 1e9);
+        r.actions++;
+
+        if (a.type == CPlayback::DRIVE) {
+            double vx, vy;
+            if (CTurnPlanner::drive_motion(a.dir, vx, vy)) set_wheels(vx, vy, 0, a.value);
+        } else if (a.type == CPlayback::TURN) {
+            double omega;
+            if (turns.plan(a.facing, a.dir, omega) > 0) set_wheels(0, 0, omega, TURN_DUTY);
+            facing = a.dir;
+        } else if (a.type == CPlayback::STOP) {
+            set_wheels(0, 0, 0, 0);
+        } else if (a.type == CPlayback::FORKS_TO || a.type == CPlayback::FORKS_BY) {
+            if (a.channel < CForkPlanner::RIGHT_FORK || a.channel > CForkPlanner::BOTH_FORKS) continue;
+
+            // the planner scales both forks to the longest move, so they finish together
+            double longest = 0;
+            for (int f = 0; f < 2; f++) {
+                if (a.channel != CForkPlanner::BOTH_FORKS && a.channel != f) continue;
+
+                double target = a.type == CPlayback::FORKS_TO ? a.value : fork_to[f] + a.value;
+                fork_from[f] = fork_height(f);
+                fork_to[f] = target;
+                longest = max(longest, fabs(target - fork_from[f]));
+            }
+
+            double duration = forks.move_duration((int)lround(longest));
+            for (int f = 0; f < 2; f++) {
+                if (a.channel != CForkPlanner::BOTH_FORKS && a.channel != f) continue;
+
+                fork_start[f] = now;
+                fork_end[f] = now + duration;
+            }
+        } else if (a.type == CPlayback::FORKS_WAIT) {
+            advance(max(fork_end[0], fork_end[1]));
+        } else if (a.type == CPlayback::END) {
+            set_wheels(0, 0, 0, 0);
+            break;
+        }
+    }
+
+    r.cycle_s = now;
+    r.x = x;
+    r.y = y;
+    r.heading = theta * 180 / M_PI;
+
+    double expected = (facing - CTurnPlanner::FORWARD) * 90.0;
+    r.heading_error = fmod(fmod(r.heading - expected, 360) + 540, 360) - 180;
+
+    for (int f = 0; f < 2; f++) r.fork_height[f] = (int)lround(fork_height(f));
+
+    return r;
+}
+
+void CKinematicSim::run_batch(const vector<job>& jobs, vector<result>& results, int threads) const {
+    results.assign(jobs.size(), result());
+
+    if (threads <= 0) threads = max(1u, thread::hardware_concurrency());
+    threads = min(threads, (int)max((size_t)1, jobs.size()));
+
+    // each worker takes the next job until there are none left
+    atomic<size_t> next(0);
+    vector<thread> workers;
+
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(thread([&]() {
+            for (size_t i = next++; i < jobs.size(); i = next++) results[i] = run(jobs[i]);
+        }));
+    }
+
+    for (size_t t = 0; t < workers.size(); t++) workers[t].join();
+}
+
+void CKinematicSim::print_results(const vector<job>& jobs, const vector<result>& results) {
+    printf("recording,turn_90_ms,turn_180_ms,strafe_gain,optimise,cycle_s,x_m,y_m,heading_deg,heading_error_deg,right_fork,left_fork\n");
+
+    for (size_t i = 0; i < jobs.size() && i < results.size(); i++) {
+        const job& j = jobs[i];
+        const result& r = results[i];
+
+        printf("%s,%d,%d,%.3f,%d,", j.path.c_str(), j.turn_90_ms, j.turn_180_ms, j.strafe_gain, j.optimise ? 1 : 0);
+        if (!r.ok) {
+            printf("could not read recording\n");
+            continue;
+        }
+
+        printf("%.3f,%.3f,%.3f,%.1f,%.1f,%d,%d\n", r.cycle_s, r.x, r.y, r.heading, r.heading_error, r.fork_height[0], r.fork_height[1]);
+    }
+}
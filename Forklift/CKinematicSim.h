@@ -0,0 +1,121 @@
+#pragma once
+#include "CPlayback.h"
+#include "CForkPlanner.h"
+#include "CMixer.h"
+#include "CTurnPlanner.h"
+#include <string>
+#include <vector>
+
+/**
+*
+* @brief Plays recordings against a mecanum kinematic model, much faster than real time
+*
+* A run compiles a recording the way play_back does, then steps through the
+* plan on a virtual clock. Wheel commands come from the same CMixer and
+* CTurnPlanner the forklift drives with, each wheel follows its command with a
+* first-order lag and the wheel speeds are integrated into a pose. Fork moves
+* take as long as the CForkPlanner profile says, and FORKS_WAIT holds the
+* plan back until they finish, as it does on the forklift.
+*
+* The fork planner is only read, so one simulator can run a batch of jobs on
+* every core at once.
+*
+*/
+class CKinematicSim {
+public:
+	/**
+	* @brief physical constants of the chassis
+	*/
+	struct model {
+		double wheel_radius;    // m
+		double half_length;     // centre to front axle, m
+		double half_width;      // centre to wheel contact, m
+		double max_wheel_speed; // rad/s at full duty
+		double time_constant;   // s for a wheel to get 63% of the way to a new speed
+		double wheel_scale[4];  // speed of each wheel relative to the others, to model a weak motor
+		double dt;              // integration step, s
+	};
+
+	/**
+	* @brief one run: a recording and the settings it is played with
+	*/
+	struct job {
+		std::string path;
+		int turn_90_ms;
+		int turn_180_ms;
+		double strafe_gain;  // back left sideways gain in the mixer
+		bool optimise;       // compile with CPlanOptimiser instead of CPlayback
+		bool retime_turns;   // time turns from turn_90_ms and turn_180_ms instead of the recording
+	};
+
+	/**
+	* @brief where a run ended up
+	*/
+	struct result {
+		bool ok;                  // false if the recording could not be read
+		double cycle_s;           // virtual time at END
+		double x, y;              // m forward and to the left of the start
+		double heading;           // degrees anticlockwise from the start
+		double heading_error;     // degrees from the heading the last turn asked for
+		int fork_height[2];       // steps, right and left
+		unsigned long actions;
+	};
+
+	/** @brief CKinematicSim constructor
+	*
+	* @param forks Used to compile plans and time fork moves. Only read
+	* @param m The chassis model
+	* @return nothing to return
+	*/
+	CKinematicSim(const CForkPlanner& forks, const model& m = default_model());
+
+	/** @brief Gets a model of the forklift's chassis with 60 mm wheels
+	*
+	* @return Returns the model
+	*/
+	static model default_model();
+
+	/** @brief Gets a job with the settings the forklift uses
+	*
+	* @param path The recording
+	* @return Returns the job
+	*/
+	static job default_job(const std::string& path);
+
+	/** @brief Loads, compiles and simulates one job
+	*
+	* @param j The job
+	* @return Returns the result
+	*/
+	result run(const job& j) const;
+
+	/** @brief Simulates a compiled plan
+	*
+	* @param actions The plan, ending with END
+	* @param mixer Mixes drive and turn commands into wheel duties
+	* @param turns Plans the turns
+	* @return Returns the result
+	*/
+	result simulate(const std::vector<CPlayback::action>& actions, const CMixer& mixer, const CTurnPlanner& turns) const;
+
+	/** @brief Runs jobs in parallel
+	*
+	* @param jobs The jobs
+	* @param results The result of each job, in the same order
+	* @param threads Threads to run on, 0 for one per core
+	* @return nothing to return
+	*/
+	void run_batch(const std::vector<job>& jobs, std::vector<result>& results, int threads = 0) const;
+
+	/** @brief Prints a line per job, comma separated with a header line
+	*
+	* @param jobs The jobs
+	* @param results Their results
+	* @return nothing to return
+	*/
+	static void print_results(const std::vector<job>& jobs, const std::vector<result>& results);
+
+private:
+    const CForkPlanner& forks;
+    model m;
+};
@@ -0,0 +1,125 @@
+#pragma once
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <utility>
+
+/**
+*
+* @brief Hands the newest item from one thread to another, dropping stale ones
+*
+* Three items are kept and only their roles swap: the producer fills the back
+* item, publish swaps it with the latest, and take swaps the latest to the
+* front for the consumer. Nothing is copied, so an item that owns a buffer
+* (a cv::Mat, a vector) keeps its allocation from one use to the next. A
+* consumer that falls behind only ever sees the newest item, and every item it
+* never saw counts as dropped.
+*
+*/
+template <typename T>
+class CLatestSlot {
+public:
+	/** @brief CLatestSlot constructor
+	*
+	* @return nothing to return
+	*/
+	CLatestSlot() : back_index(0), latest_index(1), front_index(2), fresh(false), closed(false), dropped(0) {}
+
+	/** @brief Gets the item to fill. Only call from the producer thread
+	*
+	* @return Returns the back item. It holds whatever it held three publishes ago
+	*/
+	T& back() {
+		return items[back_index];
+	}
+
+	/** @brief Makes the back item the latest and wakes the consumer. Only call from the producer thread
+	*
+	* @return Returns a bool. (True --> Published) (False --> Published, and the item it replaced was never taken)
+	*/
+	bool publish() {
+		bool stale;
+		{
+			std::lock_guard<std::mutex> lock(m);
+			std::swap(back_index, latest_index);
+			stale = fresh;
+			if (stale) dropped++;
+			fresh = true;
+		}
+		ready.notify_one();
+		return !stale;
+	}
+
+	/** @brief Waits for an item newer than the last one taken. Only call from the consumer thread
+	*
+	* @param timeout_ms Longest wait, 0 to only check
+	* @return Returns a bool. (True --> front is the new item) (False --> Timed out or closed)
+	*/
+	bool take(int timeout_ms = 0) {
+		std::unique_lock<std::mutex> lock(m);
+		if (timeout_ms > 0) ready.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this]() { return fresh || closed; });
+		if (!fresh) return false;
+
+		std::swap(front_index, latest_index);
+		fresh = false;
+		return true;
+	}
+
+	/** @brief Gets the item last taken. Only call from the consumer thread
+	*
+	* @return Returns the front item
+	*/
+	T& front() {
+		return items[front_index];
+	}
+
+	/** @brief Wakes the consumer for good. An item already published can still be taken
+	*
+	* @return nothing to return
+	*/
+	void close() {
+		{
+			std::lock_guard<std::mutex> lock(m);
+			closed = true;
+		}
+		ready.notify_all();
+	}
+
+	/** @brief Makes the slot ready for a new producer. Only call while neither thread is using it
+	*
+	* @return nothing to return
+	*/
+	void reset() {
+		std::lock_guard<std::mutex> lock(m);
+		fresh = false;
+		closed = false;
+		dropped = 0;
+	}
+
+	/** @brief Checks if the producer has finished
+	*
+	* @return Returns a bool. (True --> Closed) (False --> Open)
+	*/
+	bool is_closed() {
+		std::lock_guard<std::mutex> lock(m);
+		return closed;
+	}
+
+	/** @brief Gets how many items were replaced before the consumer took them
+	*
+	* @return Returns the number of dropped items
+	*/
+	unsigned long get_dropped() {
+		std::lock_guard<std::mutex> lock(m);
+		return dropped;
+	}
+
+private:
+    T items[3];
+    int back_index, latest_index, front_index;
+    bool fresh;  // latest hasn't been taken yet
+    bool closed;
+    unsigned long dropped;
+    std::mutex m;
+    std::condition_variable ready;
+};
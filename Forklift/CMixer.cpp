@@ -0,0 +1,42 @@
+#include "CMixer.h"
+#include <math.h>
+
+// wheel direction for each part of the motion. Rollers on the front left and back
+// right wheels push sideways opposite to the other two
+static const double SIGNS[4][3] = {
+    {1,  1,  1},  // front left
+    {1, -1, -1},  // front right
+    {1, -1,  1},  // back left
+    {1,  1, -1},  // back right
+};
+
+CMixer::CMixer() {
+    for (int w = 0; w < 4; w++) {
+        for (int a = 0; a < 3; a++) weights[w][a] = SIGNS[w][a];
+    }
+
+    // the back left wheel drags the forklift into a turn when strafing at full power
+    set_gain(2, VY, 0.8);
+}
+
+void CMixer::set_gain(int wheel, int axis, double gain) {
+    if (wheel < 0 || wheel > 3 || axis < VX || axis > OMEGA) return;
+    weights[wheel][axis] = SIGNS[wheel][axis] * gain;
+}
+
+double CMixer::get_gain(int wheel, int axis) const {
+    if (wheel < 0 || wheel > 3 || axis < VX || axis > OMEGA) return 0;
+    return weights[wheel][axis] * SIGNS[wheel][axis];
+}
+
+void CMixer::mix(double vx, double vy, double omega, int max_duty, int duty[4]) const {
+    double out[4];
+    double largest = 1;
+
+    for (int w = 0; w < 4; w++) {
+        out[w] = weights[w][VX] * vx + weights[w][VY] * vy + weights[w][OMEGA] * omega;
+        if (fabs(out[w]) > largest) largest = fabs(out[w]);
+    }
+
+    for (int w = 0; w < 4; w++) duty[w] = (int)lround(out[w] / largest * max_duty);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+/**
+*
+* @brief Mixes a body motion command into duty cycles for the four mecanum wheels
+*
+* Wheels are indexed front left, front right, back left, back right. Each
+* wheel's duty is a weighted sum of the forward, sideways and rotation
+* commands, where the weights are the mecanum signs times a calibration gain,
+* so a wheel that runs fast or slow in one kind of motion can be trimmed on its own.
+*
+*/
+class CMixer {
+public:
+	/**
+	* @brief parts of a motion command
+	*/
+	enum axis{VX = 0, VY, OMEGA};
+
+	/** @brief CMixer constructor. All gains start at 1 except the back left sideways
+	* gain, which is 0.8 to keep strafes straight
+	*
+	* @return nothing to return
+	*/
+	CMixer();
+
+	/** @brief Sets the calibration gain of one wheel for one part of the motion
+	*
+	* @param wheel 0 front left, 1 front right, 2 back left, 3 back right
+	* @param axis VX, VY or OMEGA
+	* @param gain Multiplier on the wheel's share of that motion
+	* @return nothing to return
+	*/
+	void set_gain(int wheel, int axis, double gain);
+
+	/** @brief Gets the calibration gain of one wheel for one part of the motion
+	*
+	* @param wheel 0 front left, 1 front right, 2 back left, 3 back right
+	* @param axis VX, VY or OMEGA
+	* @return Returns the gain
+	*/
+	double get_gain(int wheel, int axis) const;
+
+	/** @brief Works out the wheel duty cycles for a motion. If a wheel would need more
+	* than full power, all wheels are scaled down together so the direction of motion is kept
+	*
+	* @param vx Forward speed, -1 to 1
+	* @param vy Sideways speed to the right, -1 to 1
+	* @param omega Clockwise rotation, -1 to 1
+	* @param max_duty Duty cycle at full speed
+	* @param duty The signed duty cycle of each wheel. Negative is backward
+	* @return nothing to return
+	*/
+	void mix(double vx, double vy, double omega, int max_duty, int duty[4]) const;
+
+private:
+    double weights[4][3]; // mecanum sign times calibration gain, per wheel and axis
+};
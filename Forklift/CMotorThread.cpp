@@ -0,0 +1,160 @@
+#include "CMotorThread.h"
+#include <iostream>
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+using namespace std;
+
+CMotorThread::CMotorThread(size_t capacity) : queue(capacity) {
+    running = false;
+    sent = 0;
+    done = 0;
+    dropped_commands = 0;
+    waited_commands = 0;
+    memset(&stats, 0, sizeof(stats));
+    sem_init(&wake, 0, 0);
+}
+
+CMotorThread::~CMotorThread() {
+    stop();
+    sem_destroy(&wake);
+}
+
+bool CMotorThread::start(function<void(const command&)> handler, int cpu, int priority) {
+    if (running) return true;
+
+    this->handler = handler;
+    bool realtime = true;
+
+    // a page fault on the motor thread costs more than the whole command, keep everything resident
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        cout << "Could not lock memory for the motor thread: " << strerror(errno) << "\n";
+        realtime = false;
+    }
+
+    running = true;
+    motor = thread(&CMotorThread::motor_loop, this);
+
+    sched_param param;
+    param.sched_priority = priority;
+    int err = pthread_setschedparam(motor.native_handle(), SCHED_FIFO, &param);
+    if (err != 0) {
+        cout << "Could not make the motor thread real-time: " << strerror(err) << "\n";
+        realtime = false;
+    }
+
+    if (cpu < 0) cpu = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    err = pthread_setaffinity_np(motor.native_handle(), sizeof(cpus), &cpus);
+    if (err != 0) {
+        cout << "Could not pin the motor thread to core " << cpu << ": " << strerror(err) << "\n";
+        realtime = false;
+    }
+
+    return realtime;
+}
+
+bool CMotorThread::send(command c, bool must_run) {
+    if (!running) return false;
+
+    c.sent_ns = now_ns();
+    if (!queue.push(c)) {
+        if (!must_run) {
+            dropped_commands++;
+            return false;
+        }
+
+        // a stop can't be lost, the motor thread is behind but still emptying the queue
+        waited_commands++;
+        do {
+            sem_post(&wake);
+            usleep(100);
+            if (!running) return false;
+        } while (!queue.push(c));
+    }
+
+    sent++;
+    sem_post(&wake);
+    return true;
+}
+
+void CMotorThread::sync() {
+    while (running && done < sent) usleep(100);
+}
+
+void CMotorThread::stop() {
+    if (!running) return;
+
+    running = false;
+    sem_post(&wake);
+    motor.join();
+}
+
+CMotorThread::latency_stats CMotorThread::get_stats() const {
+    latency_stats s = stats;
+    s.dropped = dropped_commands;
+    s.waited = waited_commands;
+    return s;
+}
+
+void CMotorThread::print_stats() const {
+    latency_stats s = get_stats();
+    if (s.commands == 0) return;
+
+    cout << "Motor commands: " << s.commands << " (" << s.dropped << " dropped, " << s.waited << " waited for room), queued avg "
+         << s.queued_sum / (double)s.commands / 1000 << " us, max " << s.queued_max / 1000.0 << " us\n";
+
+    if (s.events > 0) {
+        cout << "Input to GPIO latency: avg " << s.event_sum / (double)s.events / 1e6 << " ms, max "
+             << s.event_max / 1e6 << " ms over " << s.events << " commands\n";
+    }
+}
+
+int64_t CMotorThread::now_ns() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+void CMotorThread::motor_loop() {
+    // touch the stack up front so the first commands don't fault it in
+    volatile char stack[64 * 1024];
+    memset((char*)stack, 0, sizeof(stack));
+
+    command c;
+
+    while (true) {
+        while (sem_wait(&wake) != 0 && errno == EINTR);
+
+        while (queue.pop(c)) {
+            int64_t begin = now_ns();
+            handler(c);
+            int64_t end = now_ns();
+
+            int64_t queued = begin - c.sent_ns;
+            stats.commands++;
+            stats.queued_sum += queued;
+            if (queued > stats.queued_max) stats.queued_max = queued;
+
+            if (c.event_ns != 0) {
+                int64_t latency = end - c.event_ns;
+                stats.events++;
+                stats.event_sum += latency;
+                if (latency > stats.event_max) stats.event_max = latency;
+            }
+
+            done++;
+        }
+
+        // stop runs whatever was queued before it
+        if (!running && queue.empty()) break;
+    }
+}
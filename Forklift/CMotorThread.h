@@ -0,0 +1,127 @@
+#pragma once
+#include "CSpscQueue.h"
+#include <stdint.h>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <semaphore.h>
+
+/**
+*
+* @brief Runs motor commands on a dedicated real-time thread
+*
+* The input thread sends commands through a lock-free queue and a semaphore
+* wakes the motor thread, so input handling, file I/O and SDL never delay a
+* GPIO write. The motor thread runs SCHED_FIFO on its own core with the process
+* memory locked. For the best bound on latency, keep other work off that core,
+* e.g. with isolcpus= on the kernel command line.
+*
+* Each command carries the time of the input that caused it, so the thread
+* measures the full input to GPIO latency as well as the time spent queued.
+*
+*/
+class CMotorThread {
+public:
+	/**
+	* @brief one motor command. type and the arguments mean whatever the handler decides
+	*/
+	struct command {
+		int type;
+		int args[3];
+		double motion[3];
+		int64_t event_ns; // CLOCK_MONOTONIC time of the input behind the command, 0 if there was none
+		int64_t sent_ns;  // filled in by send
+	};
+
+	/**
+	* @brief latencies measured on the motor thread, in nanoseconds
+	*/
+	struct latency_stats {
+		unsigned long commands;
+		unsigned long dropped;  // commands lost because the queue was full
+		unsigned long waited;   // commands that had to wait for room in a full queue
+		int64_t queued_sum;     // send to the handler starting
+		int64_t queued_max;
+		unsigned long events;   // commands with an input time
+		int64_t event_sum;      // input to the handler finishing its GPIO writes
+		int64_t event_max;
+	};
+
+	/** @brief CMotorThread constructor
+	*
+	* @param capacity Commands the queue holds before new commands are dropped
+	* @return nothing to return
+	*/
+	CMotorThread(size_t capacity = 256);
+
+	/** @brief CMotorThread destructor. Stops the thread if it is still running
+	*
+	* @return nothing to return
+	*/
+	~CMotorThread();
+
+	/** @brief Locks the process memory and starts the motor thread
+	*
+	* @param handler Runs each command on the motor thread
+	* @param cpu Core to run on, -1 for the last core
+	* @param priority SCHED_FIFO priority
+	* @return Returns a bool. (True --> Running with real-time priority) (False --> Running, but without real-time priority, memory locking or pinning)
+	*/
+	bool start(std::function<void(const command&)> handler, int cpu = -1, int priority = 80);
+
+	/** @brief Queues a command for the motor thread. Only call from one thread
+	*
+	* @param c The command
+	* @param must_run Wait for room if the queue is full instead of dropping the command, for stops
+	* @return Returns a bool. (True --> Command queued) (False --> Not running, or queue full and the command dropped)
+	*/
+	bool send(command c, bool must_run = false);
+
+	/** @brief Blocks until every command sent so far has run
+	*
+	* @return nothing to return
+	*/
+	void sync();
+
+	/** @brief Runs the commands still queued and stops the motor thread
+	*
+	* @return nothing to return
+	*/
+	void stop();
+
+	/** @brief Gets the latency stats. Exact once the thread has stopped
+	*
+	* @return Returns the stats
+	*/
+	latency_stats get_stats() const;
+
+	/** @brief Prints the latency stats to the console
+	*
+	* @return nothing to return
+	*/
+	void print_stats() const;
+
+	/** @brief Gets the current CLOCK_MONOTONIC time, the clock command times are in
+	*
+	* @return Returns the time in nanoseconds
+	*/
+	static int64_t now_ns();
+
+private:
+	/** @brief Runs on motor and runs commands as they arrive
+	*
+	* @return nothing to return
+	*/
+	void motor_loop();
+
+    CSpscQueue<command> queue;
+    std::function<void(const command&)> handler;
+    std::thread motor;
+    sem_t wake;
+    std::atomic<bool> running;
+    std::atomic<unsigned long> sent; // written by the sending thread
+    std::atomic<unsigned long> done; // written by the motor thread
+    std::atomic<unsigned long> dropped_commands;
+    std::atomic<unsigned long> waited_commands;
+    latency_stats stats;
+};
@@ -0,0 +1,75 @@
+#include "CPigpioBackend.h"
+#include "pigpio.h"
+
+CPigpioBackend::CPigpioBackend(int sample_us, int buffer_ms) {
+    this->sample_us = sample_us;
+    this->buffer_ms = buffer_ms;
+}
+
+bool CPigpioBackend::initialise() {
+    // the clock can only be set before pigpio starts. Peripheral 1 is the PCM, pigpio's default
+    if (gpioCfgClock(sample_us, 1, 0) < 0) return false;
+    if (gpioCfgBufferSize(buffer_ms) < 0) return false;
+
+    return gpioInitialise() >= 0;
+}
+
+void CPigpioBackend::terminate() {
+    gpioTerminate();
+}
+
+int CPigpioBackend::set_mode(int pin, int mode) {
+    return gpioSetMode(pin, mode == OUTPUT ? PI_OUTPUT : PI_INPUT);
+}
+
+int CPigpioBackend::read(int pin) {
+    return gpioRead(pin);
+}
+
+int CPigpioBackend::write(int pin, int level) {
+    return gpioWrite(pin, level);
+}
+
+int CPigpioBackend::write_bits_clear(unsigned int bits) {
+    return gpioWrite_Bits_0_31_Clear(bits);
+}
+
+int CPigpioBackend::write_bits_set(unsigned int bits) {
+    return gpioWrite_Bits_0_31_Set(bits);
+}
+
+int CPigpioBackend::pwm(int pin, int duty) {
+    return gpioPWM(pin, duty);
+}
+
+int CPigpioBackend::set_pwm_frequency(int pin, int frequency) {
+    return gpioSetPWMfrequency(pin, frequency);
+}
+
+int CPigpioBackend::set_pwm_range(int pin, int range) {
+    return gpioSetPWMrange(pin, range);
+}
+
+int CPigpioBackend::get_pwm_real_range(int pin) {
+    return gpioGetPWMrealRange(pin);
+}
+
+int CPigpioBackend::hardware_pwm(int pin, int frequency, int duty) {
+    return gpioHardwarePWM(pin, frequency, duty);
+}
+
+int CPigpioBackend::servo(int pin, int pulse_us) {
+    return gpioServo(pin, pulse_us);
+}
+
+int CPigpioBackend::spi_open(int channel, int baud, int flags) {
+    return spiOpen(channel, baud, flags);
+}
+
+int CPigpioBackend::spi_xfer(int handle, char* tx, char* rx, int count) {
+    return spiXfer(handle, tx, rx, count);
+}
+
+int CPigpioBackend::spi_close(int handle) {
+    return spiClose(handle);
+}
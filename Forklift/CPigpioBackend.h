@@ -0,0 +1,45 @@
+#pragma once
+#include "CBackend.h"
+
+/**
+*
+* @brief CBackend that drives the Raspberry Pi pins through pigpio
+*
+* pigpio samples the pins and times DMA PWM from a clock set before it starts.
+* A slower clock costs less CPU all the time but gives coarser DMA PWM frequencies.
+*
+*/
+class CPigpioBackend : public CBackend {
+public:
+	/** @brief CPigpioBackend constructor
+	*
+	* @param sample_us pigpio sample clock in microseconds, 1, 2, 4, 5, 8 or 10. pigpio's own default is 5
+	* @param buffer_ms Length of pigpio's sample buffer in milliseconds, 100 to 10000
+	* @return nothing to return
+	*/
+	CPigpioBackend(int sample_us = 10, int buffer_ms = 120);
+
+	bool initialise();
+	void terminate();
+
+	int set_mode(int pin, int mode);
+	int read(int pin);
+	int write(int pin, int level);
+	int write_bits_clear(unsigned int bits);
+	int write_bits_set(unsigned int bits);
+
+	int pwm(int pin, int duty);
+	int set_pwm_frequency(int pin, int frequency);
+	int set_pwm_range(int pin, int range);
+	int get_pwm_real_range(int pin);
+	int hardware_pwm(int pin, int frequency, int duty);
+	int servo(int pin, int pulse_us);
+
+	int spi_open(int channel, int baud, int flags);
+	int spi_xfer(int handle, char* tx, char* rx, int count);
+	int spi_close(int handle);
+
+private:
+    int sample_us;
+    int buffer_ms;
+};
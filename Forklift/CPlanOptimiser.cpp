@@ -0,0 +1,252 @@
+#include "CPlanOptimiser.h"
+#include <iostream>
+#include <stdlib.h>
+
+using namespace std;
+
+static bool is_turn(const CRecorder::record& r) {
+    return r.type == CRecorder::DC && r.facing != -1;
+}
+
+static bool is_drive(const CRecorder::record& r) {
+    return r.type == CRecorder::DC && r.facing == -1;
+}
+
+static bool is_fork(const CRecorder::record& r) {
+    return r.type == CRecorder::FORKS || r.type == CRecorder::STEPPER;
+}
+
+CPlanOptimiser::CPlanOptimiser(const CForkPlanner& forks, int pause_ms, int clear_steps) : forks(forks) {
+    this->pause_ms = pause_ms;
+    this->clear_steps = clear_steps;
+    last = report{0, 0, 0, 0, 0, 0, 0, 0, 0};
+}
+
+bool CPlanOptimiser::fork_targets(const CRecorder::record& r, int heights[2], bool moved[2]) const {
+    if (!is_fork(r) || r.channel < CForkPlanner::RIGHT_FORK || r.channel > CForkPlanner::BOTH_FORKS) return false;
+
+    // older recordings store relative steps, the direction matches CPlayback::compile
+    int steps = r.dir == forks.up_dir(r.channel) ? r.value : -r.value;
+
+    for (int f = 0; f < 2; f++) {
+        bool selected = r.channel == CForkPlanner::BOTH_FORKS || r.channel == f;
+        int target = heights[f];
+
+        if (selected) target = r.type == CRecorder::FORKS ? r.value : heights[f] + steps;
+
+        moved[f] = target != heights[f];
+        heights[f] = target;
+    }
+
+    return true;
+}
+
+void CPlanOptimiser::simplify(const vector<CRecorder::record>& records, vector<CRecorder::record>& simplified) {
+    int heights[2] = {forks.target(CForkPlanner::RIGHT_FORK), forks.target(CForkPlanner::LEFT_FORK)};
+
+    simplified.clear();
+    last.records_in = records.size();
+    last.dropped = 0;
+    last.merged = 0;
+
+    for (size_t i = 0; i < records.size(); i++) {
+        const CRecorder::record& r = records[i];
+
+        if (is_turn(r)) {
+            // a turn to the way the forklift already faces never moves
+            if (r.duration_ns <= 0 || r.dir == r.facing) {
+                last.dropped++;
+                continue;
+            }
+        } else if (is_drive(r)) {
+            if (r.duration_ns <= 0 || r.value <= 0) {
+                last.dropped++;
+                continue;
+            }
+
+            // the wheels would stop and set off the same way again, drive straight through instead
+            if (!simplified.empty()) {
+                CRecorder::record& prev = simplified.back();
+
+                if (is_drive(prev) && prev.dir == r.dir && prev.value == r.value) {
+                    prev.duration_ns += r.duration_ns;
+                    last.merged++;
+                    continue;
+                }
+            }
+        } else {
+            bool moved[2];
+            if (!fork_targets(r, heights, moved) || (!moved[0] && !moved[1])) {
+                last.dropped++;
+                continue;
+            }
+        }
+
+        simplified.push_back(r);
+    }
+
+    last.records_out = simplified.size();
+}
+
+int64_t CPlanOptimiser::add_fork_moves(const int from[2], const int to[2], int64_t at_ns, vector<CPlayback::action>& actions) const {
+    int steps[2] = {abs(to[0] - from[0]), abs(to[1] - from[1])};
+    int longest = max(steps[0], steps[1]);
+
+    if (longest == 0) return 0;
+
+    if (steps[0] > 0 && steps[1] > 0 && to[0] == to[1]) {
+        // one move for both forks keeps them in lockstep
+        CPlayback::action a = {at_ns, CPlayback::FORKS_TO, CForkPlanner::BOTH_FORKS, to[0], -1, -1};
+        actions.push_back(a);
+    } else {
+        for (int f = 0; f < 2; f++) {
+            if (steps[f] == 0) continue;
+
+            CPlayback::action a = {at_ns, CPlayback::FORKS_TO, f, to[f], -1, -1};
+            actions.push_back(a);
+        }
+    }
+
+    return (int64_t)(forks.move_duration(longest) * 1e9);
+}
+
+void CPlanOptimiser::compile(const vector<CRecorder::record>& records, vector<CPlayback::action>& actions) {
+    vector<CRecorder::record> simplified;
+    simplify(records, simplified);
+
+    vector<CPlayback::action> baseline;
+    CPlayback(forks, pause_ms).compile(records, baseline);
+    last.baseline_ns = baseline.back().at_ns;
+
+    int64_t t = 0;
+    int64_t settle_until = 0; // end of the pause after the last drive segment
+    int64_t forks_free = 0;   // when a move left running past its station finishes
+    bool forks_running = false;
+    int last_dir = -1;
+    int heights[2] = {forks.target(CForkPlanner::RIGHT_FORK), forks.target(CForkPlanner::LEFT_FORK)};
+    unsigned long drives = 0, pauses = 0;
+
+    last.forks_grouped = 0;
+    last.forks_overlapped = 0;
+    actions.clear();
+
+    // CPlayback pauses after every drive segment. Counted in the simplified plan, so segments that were
+    // merged or dropped are reported as that and not as pauses removed
+    for (size_t i = 0; i < simplified.size(); i++) {
+        if (is_drive(simplified[i])) drives++;
+    }
+
+    size_t i = 0;
+    while (i < simplified.size()) {
+        const CRecorder::record& r = simplified[i];
+
+        if (is_turn(r) || is_drive(r)) {
+            // the chassis only has to settle before the wheels set off a different way
+            if (is_turn(r) || r.dir != last_dir) {
+                if (settle_until > t) {
+                    t = settle_until;
+                    pauses++;
+                }
+            }
+
+            CPlayback::action a = {t, is_turn(r) ? CPlayback::TURN : CPlayback::DRIVE, r.channel, r.value, r.dir, r.facing};
+            actions.push_back(a);
+
+            t += r.duration_ns;
+            CPlayback::action stop = {t, CPlayback::STOP, -1, 0, -1, -1};
+            actions.push_back(stop);
+
+            if (is_drive(r)) {
+                settle_until = t + pause_ms * 1000000LL;
+                last_dir = r.dir;
+            } else {
+                last_dir = -1;
+            }
+
+            i++;
+            continue;
+        }
+
+        // back to back moves on different forks start together
+        int from[2] = {heights[0], heights[1]};
+        bool used[2] = {false, false};
+
+        while (i < simplified.size() && is_fork(simplified[i])) {
+            int next[2] = {heights[0], heights[1]};
+            bool moved[2];
+            fork_targets(simplified[i], next, moved);
+
+            if ((moved[0] && used[0]) || (moved[1] && used[1])) break;
+            if (used[0] || used[1]) last.forks_grouped++;
+
+            for (int f = 0; f < 2; f++) {
+                heights[f] = next[f];
+                used[f] = used[f] || moved[f];
+            }
+            i++;
+        }
+
+        if (forks_running) {
+            t = max(t, forks_free);
+            CPlayback::action wait = {t, CPlayback::FORKS_WAIT, -1, 0, -1, -1};
+            actions.push_back(wait);
+            forks_running = false;
+        }
+
+        // when the forklift drives on straight after a lift, only the first clear_steps happen at the
+        // station. A lowering move sets a pallet down, so it has to finish before the forklift leaves
+        int station[2] = {heights[0], heights[1]};
+        bool split = false;
+
+        if (clear_steps >= 0 && i < simplified.size() && is_drive(simplified[i])) {
+            for (int f = 0; f < 2; f++) {
+                int steps = heights[f] - from[f];
+                if (steps <= clear_steps) continue;
+
+                station[f] = from[f] + clear_steps;
+                split = true;
+            }
+        }
+
+        int64_t duration = add_fork_moves(from, station, t, actions);
+        if (duration > 0) {
+            t += duration;
+            CPlayback::action wait = {t, CPlayback::FORKS_WAIT, -1, 0, -1, -1};
+            actions.push_back(wait);
+        }
+
+        if (split) {
+            forks_free = t + add_fork_moves(station, heights, t, actions);
+            forks_running = true;
+            last.forks_overlapped++;
+        }
+    }
+
+    if (forks_running) {
+        t = max(t, forks_free);
+        CPlayback::action wait = {t, CPlayback::FORKS_WAIT, -1, 0, -1, -1};
+        actions.push_back(wait);
+    }
+
+    CPlayback::action end = {t, CPlayback::END, -1, 0, -1, -1};
+    actions.push_back(end);
+
+    last.pauses_removed = drives - pauses;
+    last.optimised_ns = t;
+}
+
+CPlanOptimiser::report CPlanOptimiser::get_report() const {
+    return last;
+}
+
+void CPlanOptimiser::print_report() const {
+    cout << "Plan: " << last.records_in << " records -> " << last.records_out << " (" << last.dropped << " dropped, "
+         << last.merged << " merged), " << last.pauses_removed << " pauses removed, " << last.forks_grouped
+         << " fork moves grouped, " << last.forks_overlapped << " overlapped with driving\n";
+
+    double saving = (last.baseline_ns - last.optimised_ns) / 1e9;
+    cout << "Projected cycle time " << last.baseline_ns / 1e9 << " s -> " << last.optimised_ns / 1e9 << " s, saving "
+         << saving << " s";
+    if (last.baseline_ns > 0) cout << " (" << 100.0 * saving * 1e9 / last.baseline_ns << "%)";
+    cout << "\n";
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include "CRecorder.h"
+#include "CPlayback.h"
+#include "CForkPlanner.h"
+#include <stdint.h>
+#include <vector>
+
+/**
+*
+* @brief Compiles a recording into a minimum-time playback plan
+*
+* simplify drops segments that do nothing and merges drive segments that carry
+* on in the same direction. compile then builds the plan CPlayback runs, with
+* three changes from CPlayback::compile: the settle pause is only kept before
+* the wheels set off in a new direction, fork moves on different forks run
+* together, and a fork move that raises the forks and is followed by a drive only
+* makes its first clear_steps at the station, the rest runs while the forklift
+* drives on. Lowering moves set a load down, so they always finish at their
+* station before the forklift moves. Every fork move still finishes before the
+* next one starts and before the end.
+*
+*/
+class CPlanOptimiser {
+public:
+	/**
+	* @brief what an optimisation changed
+	*/
+	struct report {
+		unsigned long records_in;
+		unsigned long records_out;
+		unsigned long dropped;          // segments that did nothing
+		unsigned long merged;           // drive segments folded into the one before
+		unsigned long pauses_removed;   // settle pauses after drive segments of the simplified recording that were not needed
+		unsigned long forks_grouped;    // fork moves started with the one before
+		unsigned long forks_overlapped; // raising fork moves finished while driving
+		int64_t baseline_ns;            // length of the plan from CPlayback::compile
+		int64_t optimised_ns;           // length of the optimised plan
+	};
+
+	/** @brief CPlanOptimiser constructor
+	*
+	* @param forks Used to work out fork heights and how long fork moves take
+	* @param pause_ms Settle pause before the wheels change direction in ms
+	* @param clear_steps Steps a raising fork move makes at the station before the forklift may drive on.
+	* Negative keeps every fork move at its station
+	* @return nothing to return
+	*/
+	CPlanOptimiser(const CForkPlanner& forks, int pause_ms = 200, int clear_steps = 100);
+
+	/** @brief Drops segments that do nothing and merges drive segments in the same direction
+	*
+	* @param records The recording
+	* @param simplified The equivalent recording
+	* @return nothing to return
+	*/
+	void simplify(const std::vector<CRecorder::record>& records, std::vector<CRecorder::record>& simplified);
+
+	/** @brief Simplifies a recording and turns it into a minimum-time plan
+	*
+	* @param records The recording
+	* @param actions The actions, in deadline order and ending with END
+	* @return nothing to return
+	*/
+	void compile(const std::vector<CRecorder::record>& records, std::vector<CPlayback::action>& actions);
+
+	/** @brief Gets what the last simplify and compile changed
+	*
+	* @return Returns the report
+	*/
+	report get_report() const;
+
+	/** @brief Prints what the last simplify and compile changed and the projected saving
+	*
+	* @return nothing to return
+	*/
+	void print_report() const;
+
+private:
+	/** @brief Works out the heights a fork record moves the forks to
+	*
+	* @param r The FORKS or STEPPER record
+	* @param heights Height of each fork before the record, updated to after it
+	* @param moved Set for each fork whose height changes
+	* @return Returns a bool. (True --> Valid fork record) (False --> Not a fork record or invalid fork)
+	*/
+	bool fork_targets(const CRecorder::record& r, int heights[2], bool moved[2]) const;
+
+	/** @brief Adds the actions that move the forks between two sets of heights
+	*
+	* @param from Height of each fork before the move
+	* @param to Height of each fork after the move
+	* @param at_ns Deadline of the actions
+	* @param actions The actions to add to
+	* @return Returns the planned duration of the move in ns, 0 if nothing moves
+	*/
+	int64_t add_fork_moves(const int from[2], const int to[2], int64_t at_ns, std::vector<CPlayback::action>& actions) const;
+
+    const CForkPlanner& forks;
+    int pause_ms;
+    int clear_steps;
+    report last;
+};
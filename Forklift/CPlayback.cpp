@@ -0,0 +1,71 @@
+#include "CPlayback.h"
+#include <stdlib.h>
+#include <algorithm>
+
+using namespace std;
+
+CPlayback::CPlayback(const CForkPlanner& forks, int pause_ms) : forks(forks) {
+    this->pause_ms = pause_ms;
+}
+
+void CPlayback::compile_record(const CRecorder::record& r, int64_t& t, int heights[2], vector<action>& actions) const {
+    action a = {t, STOP, r.channel, r.value, r.dir, r.facing};
+
+    if (r.type == CRecorder::DC && r.facing != -1) {
+        // turn, then stop when the recorded turn time is up
+        a.type = TURN;
+        actions.push_back(a);
+
+        t += r.duration_ns;
+        action stop = {t, STOP, -1, 0, -1, -1};
+        actions.push_back(stop);
+    } else if (r.type == CRecorder::DC) {
+        // drive segment, then stop and settle before the next command
+        a.type = DRIVE;
+        actions.push_back(a);
+
+        t += r.duration_ns;
+        action stop = {t, STOP, -1, 0, -1, -1};
+        actions.push_back(stop);
+
+        t += pause_ms * 1000000LL;
+    } else if (r.type == CRecorder::FORKS || r.type == CRecorder::STEPPER) {
+        if (r.channel < CForkPlanner::RIGHT_FORK || r.channel > CForkPlanner::BOTH_FORKS) return;
+
+        bool moving[2] = {r.channel != CForkPlanner::LEFT_FORK, r.channel != CForkPlanner::RIGHT_FORK};
+        int longest = 0;
+
+        if (r.type == CRecorder::FORKS) {
+            a.type = FORKS_TO;
+        } else {
+            // older recordings store relative steps for a single fork
+            a.type = FORKS_BY;
+            if (r.dir != forks.up_dir(r.channel)) a.value = -r.value;
+        }
+
+        for (int f = 0; f < 2; f++) {
+            if (!moving[f]) continue;
+            int target = a.type == FORKS_TO ? a.value : heights[f] + a.value;
+            longest = max(longest, abs(target - heights[f]));
+            heights[f] = target;
+        }
+
+        actions.push_back(a);
+
+        // the next command is due when the planned move ends, FORKS_WAIT covers a slow move
+        t += (int64_t)(forks.move_duration(longest) * 1e9);
+        action wait = {t, FORKS_WAIT, -1, 0, -1, -1};
+        actions.push_back(wait);
+    }
+}
+
+void CPlayback::compile(const vector<CRecorder::record>& records, vector<action>& actions) const {
+    int64_t t = 0;
+    int heights[2] = {forks.target(CForkPlanner::RIGHT_FORK), forks.target(CForkPlanner::LEFT_FORK)};
+
+    actions.clear();
+    for (size_t i = 0; i < records.size(); i++) compile_record(records[i], t, heights, actions);
+
+    action end = {t, END, -1, 0, -1, -1};
+    actions.push_back(end);
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include "CRecorder.h"
+#include "CForkPlanner.h"
+#include <stdint.h>
+#include <vector>
+
+/**
+*
+* @brief Compiles a recording into actions timed against absolute deadlines
+*
+* Each action is due at a fixed offset from the start of playback, so the
+* time spent actuating one command never pushes the later ones back. CSequencer
+* runs the actions from the input thread.
+*
+*/
+class CPlayback {
+public:
+	/**
+	* @brief things playback can ask the caller to do
+	*/
+	enum action_type{DRIVE = 0, STOP, TURN, FORKS_TO, FORKS_BY, FORKS_WAIT, END};
+
+	/**
+	* @brief one timed action
+	*/
+	struct action {
+		int64_t at_ns;  // deadline, measured from the start of playback
+		int type;       // action_type
+		int channel;    // fork for FORKS_TO and FORKS_BY
+		int value;      // duty cycle, fork height or steps
+		int dir;        // drive direction or the facing to turn to
+		int facing;     // facing before a turn
+	};
+
+	/**
+	* @brief how far behind their deadlines actions ran
+	*/
+	struct timing_stats {
+		unsigned long actions;
+		int64_t total_ns;  // sum of lateness
+		int64_t max_ns;
+		int64_t end_ns;    // lateness of the END action, the drift over the whole routine
+		unsigned long rebased; // actions late enough to move the rest of the routine back
+	};
+
+	/** @brief CPlayback constructor
+	*
+	* @param forks Used to work out how long fork moves take
+	* @param pause_ms Stop between drive segments in ms
+	* @return nothing to return
+	*/
+	CPlayback(const CForkPlanner& forks, int pause_ms = 200);
+
+	/** @brief Turns recorded commands into timed actions
+	*
+	* @param records The recording
+	* @param actions The actions, in deadline order and ending with END
+	* @return nothing to return
+	*/
+	void compile(const std::vector<CRecorder::record>& records, std::vector<action>& actions) const;
+
+private:
+	/** @brief Adds the actions for one record
+	*
+	* @param r The record
+	* @param t Deadline of the record's first action, moved on to the next record's
+	* @param heights Target of each fork before the record, updated to after it
+	* @param actions The actions to add to
+	* @return nothing to return
+	*/
+	void compile_record(const CRecorder::record& r, int64_t& t, int heights[2], std::vector<action>& actions) const;
+
+    const CForkPlanner& forks;
+    int pause_ms;
+};
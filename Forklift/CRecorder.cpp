@@ -0,0 +1,231 @@
+#include "CRecorder.h"
+#include <string.h>
+#include <unistd.h>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+
+using namespace std;
+
+static const char MAGIC[4] = {'F', 'K', 'L', 'R'};
+static const uint16_t VERSION = 1;
+static const char* type_names[] = {"DC", "STEPPER", "FORKS"};
+
+static_assert(sizeof(CRecorder::record) == 24, "record layout is part of the file format");
+static_assert(sizeof(CRecorder::file_header) == 16, "file_header layout is part of the file format");
+
+static int64_t steady_ns() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CRecorder::CRecorder(size_t capacity) : queue(capacity) {
+    file = NULL;
+    start_ns = 0;
+    running = false;
+    dropped_records = 0;
+}
+
+CRecorder::~CRecorder() {
+    close();
+}
+
+bool CRecorder::open(const string& path) {
+    close();
+
+    file = fopen(path.c_str(), "wb");
+    if (file == NULL) return false;
+
+    start_ns = steady_ns();
+    dropped_records = 0;
+
+    file_header header;
+    memcpy(header.magic, MAGIC, 4);
+    header.version = VERSION;
+    header.record_size = sizeof(record);
+    header.start_ns = start_ns;
+    fwrite(&header, sizeof(header), 1, file);
+
+    running = true;
+    writer = thread(&CRecorder::write_loop, this);
+
+    return true;
+}
+
+bool CRecorder::push(record r) {
+    if (!running) return false;
+
+    if (r.time_ns < 0) r.time_ns = steady_ns() - start_ns;
+
+    if (!queue.push(r)) {
+        dropped_records++;
+        return false;
+    }
+
+    return true;
+}
+
+void CRecorder::close() {
+    if (file == NULL) return;
+
+    running = false;
+    if (writer.joinable()) writer.join();
+
+    drain();
+    fclose(file);
+    file = NULL;
+}
+
+unsigned long CRecorder::dropped() const {
+    return dropped_records;
+}
+
+void CRecorder::write_loop() {
+    // records are small and rare, waking every few ms keeps the queue short without a lock
+    while (running) {
+        drain();
+        usleep(5000);
+    }
+}
+
+void CRecorder::drain() {
+    record batch[64];
+    size_t n = 0;
+
+    while (queue.pop(batch[n])) {
+        if (++n == 64) {
+            fwrite(batch, sizeof(record), n, file);
+            n = 0;
+        }
+    }
+
+    if (n > 0) fwrite(batch, sizeof(record), n, file);
+    fflush(file);
+}
+
+CRecorder::record CRecorder::make_record(int type, int channel, int value, int dir, int64_t duration_ns, int facing) {
+    record r;
+    r.time_ns = -1;
+    r.duration_ns = duration_ns;
+    r.value = value;
+    r.type = type;
+    r.channel = channel;
+    r.dir = dir;
+    r.facing = facing;
+
+    return r;
+}
+
+// motor_type, channel, steps (duty cycle, fork height), dir, duration, facing
+static bool load_text(const string& path, vector<CRecorder::record>& records) {
+    ifstream infile(path.c_str());
+    if (!infile.is_open()) return false;
+
+    string line;
+    int64_t time_ns = 0;
+
+    while (getline(infile, line)) {
+        istringstream fields(line);
+        string motor_type;
+        int channel, value, dir, facing;
+        double duration;
+
+        if (!(fields >> motor_type >> channel >> value >> dir >> duration >> facing)) continue;
+
+        int type;
+        if (motor_type == "DC") type = CRecorder::DC;
+        else if (motor_type == "STEPPER") type = CRecorder::STEPPER;
+        else if (motor_type == "FORKS") type = CRecorder::FORKS;
+        else continue;
+
+        // turns store their duration in ms, drive segments in seconds
+        int64_t duration_ns = -1;
+        if (type == CRecorder::DC) duration_ns = (int64_t)(facing != -1 ? duration * 1e6 : duration * 1e9);
+
+        CRecorder::record r = CRecorder::make_record(type, channel, value, dir, duration_ns, facing);
+
+        // the text format has no timestamps, rebuild them from the segment lengths
+        r.time_ns = time_ns;
+        if (duration_ns > 0) time_ns += duration_ns;
+
+        records.push_back(r);
+    }
+
+    return true;
+}
+
+bool CRecorder::load(const string& path, vector<record>& records) {
+    records.clear();
+
+    FILE* in = fopen(path.c_str(), "rb");
+    if (in == NULL) return false;
+
+    file_header header;
+    bool binary = fread(&header, sizeof(header), 1, in) == 1 && memcmp(header.magic, MAGIC, 4) == 0;
+
+    if (!binary) {
+        fclose(in);
+        return load_text(path, records);
+    }
+
+    if (header.version != VERSION || header.record_size != sizeof(record)) {
+        fclose(in);
+        return false;
+    }
+
+    record r;
+    while (fread(&r, sizeof(r), 1, in) == 1) records.push_back(r);
+
+    fclose(in);
+    return true;
+}
+
+bool CRecorder::save_binary(const string& path, const vector<record>& records) {
+    FILE* out = fopen(path.c_str(), "wb");
+    if (out == NULL) return false;
+
+    file_header header;
+    memcpy(header.magic, MAGIC, 4);
+    header.version = VERSION;
+    header.record_size = sizeof(record);
+    header.start_ns = 0;
+
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+    if (!records.empty()) ok &= fwrite(&records[0], sizeof(record), records.size(), out) == records.size();
+
+    return fclose(out) == 0 && ok;
+}
+
+bool CRecorder::save_text(const string& path, const vector<record>& records) {
+    ofstream outfile(path.c_str());
+    if (!outfile.is_open()) return false;
+
+    for (size_t i = 0; i < records.size(); i++) {
+        const record& r = records[i];
+        if (r.type < DC || r.type > FORKS) continue;
+
+        outfile << type_names[(int)r.type] << " " << (int)r.channel << " " << r.value << " " << (int)r.dir << " ";
+
+        if (r.type != DC) outfile << "-1";
+        else if (r.facing != -1) outfile << r.duration_ns / 1000000;
+        else outfile << to_string(r.duration_ns / 1e9);
+
+        outfile << " " << (int)r.facing << "\n";
+    }
+
+    return outfile.good();
+}
+
+bool CRecorder::convert(const string& in_path, const string& out_path) {
+    vector<record> records;
+    if (!load(in_path, records)) return false;
+
+    FILE* in = fopen(in_path.c_str(), "rb");
+    char magic[4] = {0, 0, 0, 0};
+    if (in != NULL) {
+        if (fread(magic, 1, 4, in) != 4) magic[0] = 0;
+        fclose(in);
+    }
+
+    if (memcmp(magic, MAGIC, 4) == 0) return save_text(out_path, records);
+    return save_binary(out_path, records);
+}
@@ -0,0 +1,150 @@
+#pragma once
+#include "CSpscQueue.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+/**
+*
+* @brief Writes recordings in a compact binary format from a background thread
+*
+* A binary recording is a file_header followed by fixed-size records. Records
+* are pushed into a lock-free queue and written by a background thread, so
+* recording never waits on the file system. Files are written in the byte order
+* of the machine (little-endian on the Pi and on x86).
+*
+* The static functions read either the binary or the older text format and
+* convert between the two.
+*
+*/
+class CRecorder {
+public:
+	/**
+	* @brief kinds of record. Match the first word of each line in the text format
+	*/
+	enum record_type{DC = 0, STEPPER, FORKS};
+
+	/**
+	* @brief one recorded command
+	*/
+	struct record {
+		int64_t time_ns;     // steady_clock time of the record, measured from the start of the recording
+		int64_t duration_ns; // how long a drive segment or turn lasted, -1 if it doesn't apply
+		int32_t value;       // duty cycle, steps or fork height
+		int8_t type;         // record_type
+		int8_t channel;      // fork for STEPPER and FORKS, -1 for DC
+		int8_t dir;          // drive direction, new facing for turns, stepper dir for STEPPER
+		int8_t facing;       // facing before a turn, -1 for drive segments
+	};
+
+	/**
+	* @brief start of every binary recording
+	*/
+	struct file_header {
+		char magic[4];        // "FKLR"
+		uint16_t version;
+		uint16_t record_size; // sizeof(record) when the file was written
+		int64_t start_ns;     // steady_clock time the recording started
+	};
+
+	/** @brief CRecorder constructor
+	*
+	* @param capacity Records the queue holds before new records are dropped
+	* @return nothing to return
+	*/
+	CRecorder(size_t capacity = 4096);
+
+	/** @brief CRecorder destructor. Closes the file if it is still open
+	*
+	* @return nothing to return
+	*/
+	~CRecorder();
+
+	/** @brief Creates a binary recording and starts the writer thread
+	*
+	* @param path The file to write
+	* @return Returns a bool. (True --> Recording started) (False --> File could not be created)
+	*/
+	bool open(const std::string& path);
+
+	/** @brief Queues a record for writing. Never blocks
+	*
+	* @param r The record. time_ns is filled in if it is negative
+	* @return Returns a bool. (True --> Record queued) (False --> Not open or queue full, record dropped)
+	*/
+	bool push(record r);
+
+	/** @brief Writes any queued records, stops the writer thread and closes the file
+	*
+	* @return nothing to return
+	*/
+	void close();
+
+	/** @brief Gets the number of records dropped because the queue was full
+	*
+	* @return Returns the dropped record count
+	*/
+	unsigned long dropped() const;
+
+	/** @brief Builds a record with the time left for push to fill in
+	*
+	* @return Returns the record
+	*/
+	static record make_record(int type, int channel, int value, int dir, int64_t duration_ns, int facing);
+
+	/** @brief Reads a recording in either the binary or the text format
+	*
+	* @param path The file to read
+	* @param records The records read from the file
+	* @return Returns a bool. (True --> File read) (False --> File missing or not a recording)
+	*/
+	static bool load(const std::string& path, std::vector<record>& records);
+
+	/** @brief Writes records in the binary format
+	*
+	* @param path The file to write
+	* @param records The records to write
+	* @return Returns a bool. (True --> File written) (False --> File could not be written)
+	*/
+	static bool save_binary(const std::string& path, const std::vector<record>& records);
+
+	/** @brief Writes records in the text format read by older versions of play_back
+	*
+	* @param path The file to write
+	* @param records The records to write
+	* @return Returns a bool. (True --> File written) (False --> File could not be written)
+	*/
+	static bool save_text(const std::string& path, const std::vector<record>& records);
+
+	/** @brief Converts a recording between the text and binary formats. The output format
+	* is the opposite of whichever format the input is in
+	*
+	* @param in_path The recording to read
+	* @param out_path The file to write
+	* @return Returns a bool. (True --> Converted) (False --> Input unreadable or output not written)
+	*/
+	static bool convert(const std::string& in_path, const std::string& out_path);
+
+private:
+	/** @brief Runs on writer and writes queued records to the file
+	*
+	* @return nothing to return
+	*/
+	void write_loop();
+
+	/** @brief Writes everything waiting in the queue
+	*
+	* @return nothing to return
+	*/
+	void drain();
+
+    CSpscQueue<record> queue;
+    FILE* file;
+    int64_t start_ns;
+    std::thread writer;
+    std::atomic<bool> running;
+    std::atomic<unsigned long> dropped_records;
+};
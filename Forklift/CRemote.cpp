@@ -0,0 +1,262 @@
+#include "CRemote.h"
+#include "CTurnPlanner.h"
+#include "CForkPlanner.h"
+#include <iostream>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/un.h>
+
+using namespace std;
+
+static const char MAGIC[2] = {'F', 'R'};
+static const uint8_t VERSION = 1;
+
+// how often the receiver checks if it should stop
+static const int RECEIVE_POLL_MS = 100;
+
+static_assert(sizeof(CRemote::header) == 16, "header layout is part of the protocol");
+static_assert(sizeof(CRemote::command) == 8, "command layout is part of the protocol");
+
+static const int MAX_PACKET = sizeof(CRemote::header) + CRemote::MAX_COMMANDS * sizeof(CRemote::command);
+
+CRemote::CRemote() : queue(64) {
+    fd = -1;
+    server = false;
+    peer_length = 0;
+    running = false;
+    last_from_length = 0;
+    last_seq = 0;
+    have_seq = false;
+    received = 0;
+    stale = 0;
+    missed = 0;
+    malformed = 0;
+    overflow = 0;
+    replies = 0;
+}
+
+CRemote::~CRemote() {
+    close();
+}
+
+bool CRemote::open(const string& address, bool server) {
+    close();
+    this->server = server;
+    have_seq = false;
+
+    if (address.compare(0, 5, "unix:") == 0) {
+        string path = address.substr(5);
+        sockaddr_un local, remote;
+        memset(&local, 0, sizeof(local));
+        memset(&remote, 0, sizeof(remote));
+        local.sun_family = AF_UNIX;
+        remote.sun_family = AF_UNIX;
+
+        // a client needs an address of its own for replies to come back to
+        string local_path = server ? path : "/tmp/forklift-remote-" + to_string(getpid()) + ".sock";
+        if (path.empty() || local_path.size() >= sizeof(local.sun_path)) return false;
+        strcpy(local.sun_path, local_path.c_str());
+        strcpy(remote.sun_path, path.c_str());
+
+        fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+        if (fd < 0) return false;
+
+        unlink(local_path.c_str());
+        if (bind(fd, (sockaddr*)&local, sizeof(local)) < 0) {
+            close();
+            return false;
+        }
+        bound_path = local_path;
+
+        memcpy(&peer, &remote, sizeof(remote));
+        peer_length = sizeof(remote);
+        return true;
+    }
+
+    if (address.compare(0, 4, "udp:") != 0) return false;
+
+    // udp:<port> listens on every interface, or sends to this machine
+    string rest = address.substr(4), host, port = rest;
+    size_t colon = rest.rfind(':');
+    if (colon != string::npos) {
+        host = rest.substr(0, colon);
+        port = rest.substr(colon + 1);
+    }
+
+    addrinfo hints, *found;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    hints.ai_flags = server && host.empty() ? AI_PASSIVE : 0;
+
+    if (getaddrinfo(host.empty() ? (server ? NULL : "127.0.0.1") : host.c_str(), port.c_str(), &hints, &found) != 0) return false;
+
+    fd = socket(found->ai_family, found->ai_socktype, found->ai_protocol);
+    bool ok = fd >= 0;
+
+    if (ok && server) ok = bind(fd, found->ai_addr, found->ai_addrlen) == 0;
+    if (ok) {
+        memcpy(&peer, found->ai_addr, found->ai_addrlen);
+        peer_length = found->ai_addrlen;
+    }
+
+    freeaddrinfo(found);
+    if (!ok) close();
+    return ok;
+}
+
+void CRemote::close() {
+    running = false;
+    if (receiver.joinable()) receiver.join();
+
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+
+    if (!bound_path.empty()) unlink(bound_path.c_str());
+    bound_path.clear();
+}
+
+bool CRemote::start(function<void()> wake) {
+    if (fd < 0 || !server || running) return false;
+
+    this->wake = wake;
+    running = true;
+    receiver = thread(&CRemote::receive_loop, this);
+    return true;
+}
+
+bool CRemote::receive(packet& p) {
+    return queue.pop(p);
+}
+
+bool CRemote::reply(const packet& p) {
+    header h = p.h;
+    h.flags = REPLY;
+
+    if (sendto(fd, &h, sizeof(h), 0, (const sockaddr*)&p.from, p.from_length) != (ssize_t)sizeof(h)) return false;
+
+    replies++;
+    return true;
+}
+
+bool CRemote::send(header h, const command* commands, int count) {
+    if (fd < 0 || count < 0 || count > MAX_COMMANDS) return false;
+
+    uint8_t data[MAX_PACKET];
+    memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.version = VERSION;
+    memcpy(data, &h, sizeof(h));
+    memcpy(data + sizeof(h), commands, count * sizeof(command));
+
+    ssize_t length = sizeof(h) + count * sizeof(command);
+    return sendto(fd, data, length, 0, (const sockaddr*)&peer, peer_length) == length;
+}
+
+bool CRemote::wait_reply(header& h, int timeout_ms) {
+    int64_t deadline = now_ns() + timeout_ms * 1000000LL;
+
+    while (true) {
+        int wait = (int)((deadline - now_ns()) / 1000000);
+        pollfd p = {fd, POLLIN, 0};
+        if (wait < 0 || poll(&p, 1, wait) <= 0) return false;
+
+        uint8_t data[MAX_PACKET];
+        ssize_t length = recv(fd, data, sizeof(data), 0);
+        if (length != (ssize_t)sizeof(h)) continue;
+
+        memcpy(&h, data, sizeof(h));
+        if (memcmp(h.magic, MAGIC, sizeof(MAGIC)) == 0 && h.version == VERSION && (h.flags & REPLY)) return true;
+    }
+}
+
+void CRemote::receive_loop() {
+    // one byte more than the largest packet, so an oversized one shows up as the wrong size
+    uint8_t data[MAX_PACKET + 1];
+    packet p;
+
+    while (running) {
+        pollfd waiting = {fd, POLLIN, 0};
+        if (poll(&waiting, 1, RECEIVE_POLL_MS) <= 0) continue;
+
+        p.from_length = sizeof(p.from);
+        ssize_t length = recvfrom(fd, data, sizeof(data), 0, (sockaddr*)&p.from, &p.from_length);
+        if (length < 0) continue;
+
+        p.received_ns = now_ns();
+        if (!decode(data, (int)length, p)) {
+            malformed++;
+            continue;
+        }
+
+        // sequence numbers run per sender, a new sender starts again
+        bool same = have_seq && p.from_length == last_from_length && memcmp(&p.from, &last_from, p.from_length) == 0;
+        if (same) {
+            int32_t ahead = (int32_t)(p.h.seq - last_seq);
+            if (ahead <= 0) {
+                stale++;
+                continue;
+            }
+            missed += ahead - 1;
+        }
+
+        memcpy(&last_from, &p.from, p.from_length);
+        last_from_length = p.from_length;
+        last_seq = p.h.seq;
+        have_seq = true;
+        received++;
+
+        if (!queue.push(p)) {
+            overflow++;
+            continue;
+        }
+
+        if (wake) wake();
+    }
+}
+
+bool CRemote::decode(const uint8_t* data, int length, packet& p) {
+    int body = length - (int)sizeof(header);
+    if (body < 0 || body % sizeof(command) != 0 || body / sizeof(command) > MAX_COMMANDS) return false;
+
+    memcpy(&p.h, data, sizeof(header));
+    if (memcmp(p.h.magic, MAGIC, sizeof(MAGIC)) != 0 || p.h.version != VERSION || (p.h.flags & REPLY)) return false;
+
+    p.count = body / sizeof(command);
+    memcpy(p.commands, data + sizeof(header), body);
+
+    for (int i = 0; i < p.count; i++) {
+        const command& c = p.commands[i];
+        if (c.type >= COMMAND_TYPES) return false;
+
+        // a heading or fork out of range would index the turn and fork tables
+        bool fork = c.type == FORKS_MOVE || c.type == FORKS_TO || c.type == FORKS_STOP;
+        if (c.type == TURN && (c.value[0] < CTurnPlanner::RIGHT || c.value[0] > CTurnPlanner::BACKWARD)) return false;
+        if (fork && (c.channel < CForkPlanner::RIGHT_FORK || c.channel > CForkPlanner::BOTH_FORKS)) return false;
+    }
+
+    return true;
+}
+
+CRemote::remote_stats CRemote::get_stats() const {
+    remote_stats s = {received, stale, missed, malformed, overflow, replies};
+    return s;
+}
+
+void CRemote::print_stats() const {
+    remote_stats s = get_stats();
+    if (s.received + s.stale + s.malformed == 0) return;
+
+    cout << "Remote packets: " << s.received << " received, " << s.stale << " stale, " << s.missed << " missed, "
+         << s.malformed << " malformed, " << s.overflow << " dropped with the queue full, " << s.replies << " replies\n";
+}
+
+int64_t CRemote::now_ns() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
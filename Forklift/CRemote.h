@@ -0,0 +1,209 @@
+#pragma once
+#include "CSpscQueue.h"
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <sys/socket.h>
+
+/**
+*
+* @brief Drives the forklift from another process over UDP or a Unix socket
+*
+* A packet is a header followed by up to MAX_COMMANDS commands, each a fixed
+* 8 bytes, so a controller can send a drive command and a fork move together.
+* Both are laid out without padding and sent as they are in memory, little
+* endian like the Pi. Every packet carries a sequence number, and one that is
+* not newer than the last packet from the same sender is dropped, so a
+* reordered or repeated datagram never undoes a newer command. A packet with
+* the ACK flag is answered with its header, the sender's timestamp included,
+* so the sender can measure the round trip without keeping any state.
+*
+* On the forklift a receiver thread decodes packets, queues them and calls a
+* wake function, so the input thread handles them as soon as they arrive.
+*
+* Addresses are udp:<port> or udp:<host>:<port>, or unix:<path>.
+*
+*/
+class CRemote {
+public:
+	/**
+	* @brief what a command asks for
+	*/
+	enum command_type{NOP = 0, DRIVE, STOP, FORKS_MOVE, FORKS_TO, FORKS_STOP, TURN, ABORT, COMMAND_TYPES};
+
+	/**
+	* @brief header flags
+	*/
+	enum flags{ACK = 1, REPLY = 2};
+
+	/**
+	* @brief most commands in one packet
+	*/
+	enum{MAX_COMMANDS = 8};
+
+	/**
+	* @brief start of every packet
+	*/
+	struct header {
+		char magic[2];     // "FR"
+		uint8_t version;
+		uint8_t flags;
+		uint32_t seq;
+		int64_t sent_ns;   // sender's clock, sent back unchanged in the reply
+	};
+
+	/**
+	* @brief one command. DRIVE takes forward, right and clockwise motion in 1/1000, FORKS_MOVE
+	* a fork, levels and steps, FORKS_TO a fork and a height, TURN a heading. Forks are RIGHT_FORK to
+	* BOTH_FORKS and headings RIGHT to BACKWARD, anything else makes the packet malformed
+	*/
+	struct command {
+		uint8_t type;
+		int8_t channel;
+		int16_t value[3];
+	};
+
+	/**
+	* @brief one packet as received, with where it came from
+	*/
+	struct packet {
+		header h;
+		int count;
+		command commands[MAX_COMMANDS];
+		int64_t received_ns;
+		sockaddr_storage from;
+		socklen_t from_length;
+	};
+
+	/**
+	* @brief what the receiver has seen since open
+	*/
+	struct remote_stats {
+		unsigned long received;
+		unsigned long stale;      // not newer than the last packet
+		unsigned long missed;     // sequence numbers skipped
+		unsigned long malformed;
+		unsigned long overflow;   // dropped because the queue was full
+		unsigned long replies;
+	};
+
+	/** @brief CRemote constructor
+	*
+	* @return nothing to return
+	*/
+	CRemote();
+
+	/** @brief CRemote destructor. Stops the receiver and closes the socket
+	*
+	* @return nothing to return
+	*/
+	~CRemote();
+
+	/** @brief Opens the socket
+	*
+	* @param address Where to listen, or for a client where to send
+	* @param server Listen on the address instead of sending to it
+	* @return Returns a bool. (True --> Open) (False --> Bad address, or the socket could not be opened)
+	*/
+	bool open(const std::string& address, bool server);
+
+	/** @brief Stops the receiver and closes the socket
+	*
+	* @return nothing to return
+	*/
+	void close();
+
+	/** @brief Starts the receiver thread of a server
+	*
+	* @param wake Called on the receiver thread after each packet is queued
+	* @return Returns a bool. (True --> Receiving) (False --> Not open as a server, or already receiving)
+	*/
+	bool start(std::function<void()> wake);
+
+	/** @brief Takes the next packet the receiver queued. Only call from one thread
+	*
+	* @param p Set to the packet
+	* @return Returns a bool. (True --> Packet taken) (False --> Nothing queued)
+	*/
+	bool receive(packet& p);
+
+	/** @brief Answers a packet with its header and the REPLY flag
+	*
+	* @param p The packet to answer
+	* @return Returns a bool. (True --> Sent) (False --> Send failed)
+	*/
+	bool reply(const packet& p);
+
+	/** @brief Sends a packet to the address a client was opened with
+	*
+	* @param h The header, the magic and version are filled in
+	* @param commands The commands
+	* @param count Number of commands, up to MAX_COMMANDS
+	* @return Returns a bool. (True --> Sent) (False --> Send failed or too many commands)
+	*/
+	bool send(header h, const command* commands, int count);
+
+	/** @brief Waits for a reply on a client
+	*
+	* @param h Set to the header that came back
+	* @param timeout_ms Longest wait
+	* @return Returns a bool. (True --> Reply received) (False --> Timed out)
+	*/
+	bool wait_reply(header& h, int timeout_ms);
+
+	/** @brief Gets what the receiver has seen since open
+	*
+	* @return Returns the stats
+	*/
+	remote_stats get_stats() const;
+
+	/** @brief Prints what the receiver has seen since open
+	*
+	* @return nothing to return
+	*/
+	void print_stats() const;
+
+	/** @brief Gets the time on the clock packets are stamped with
+	*
+	* @return Returns CLOCK_MONOTONIC in nanoseconds
+	*/
+	static int64_t now_ns();
+
+private:
+	/** @brief Runs on the receiver thread until close
+	*
+	* @return nothing to return
+	*/
+	void receive_loop();
+
+	/** @brief Checks and decodes one datagram
+	*
+	* @param data The datagram
+	* @param length Its length in bytes
+	* @param p The packet to fill in
+	* @return Returns a bool. (True --> Valid packet) (False --> Wrong size, magic, version or command, or a heading or fork out of range)
+	*/
+	static bool decode(const uint8_t* data, int length, packet& p);
+
+    int fd;
+    bool server;
+    std::string bound_path;  // unix socket file to remove on close
+    sockaddr_storage peer;   // where a client sends
+    socklen_t peer_length;
+    CSpscQueue<packet> queue;
+    std::function<void()> wake;
+    std::thread receiver;
+    std::atomic<bool> running;
+
+    // receiver thread only
+    sockaddr_storage last_from;
+    socklen_t last_from_length;
+    uint32_t last_seq;
+    bool have_seq;
+
+    // written by the receiver, read by get_stats
+    std::atomic<unsigned long> received, stale, missed, malformed, overflow;
+    std::atomic<unsigned long> replies;
+};
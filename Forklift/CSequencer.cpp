@@ -0,0 +1,148 @@
+#include "CSequencer.h"
+#include <iostream>
+#include <algorithm>
+#include <time.h>
+
+using namespace std;
+
+// how often a routine waiting on the forks checks them, in ms
+static const int FORKS_POLL_MS = 2;
+
+// an action later than this moves the rest of the routine back
+static const int64_t REBASE_NS = 5000000;
+
+static int64_t monotonic_ns() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+CSequencer::CSequencer(function<void(const CPlayback::action&)> execute, function<bool()> forks_busy)
+    : execute(execute), forks_busy(forks_busy) {
+    next = 0;
+    waiting = false;
+    shift_ns = 0;
+    start_ns = 0;
+    generation = 0;
+    running = false;
+    stats.actions = 0;
+    stats.total_ns = 0;
+    stats.max_ns = 0;
+    stats.end_ns = 0;
+    stats.rebased = 0;
+}
+
+bool CSequencer::start(const vector<CPlayback::action>& actions, function<void(bool)> done) {
+    if (running) return false;
+
+    this->actions = actions;
+    this->done = done;
+    next = 0;
+    waiting = false;
+    shift_ns = 0;
+    generation++;
+    stats.actions = 0;
+    stats.total_ns = 0;
+    stats.max_ns = 0;
+    stats.end_ns = 0;
+    stats.rebased = 0;
+    start_ns = monotonic_ns();
+    running = true;
+    return true;
+}
+
+void CSequencer::poll() {
+    if (!running) return;
+
+    // execute can cancel the routine or start another one, so the routine is
+    // moved on before each action runs
+    unsigned routine = generation;
+
+    while (next < actions.size()) {
+        if (waiting) {
+            if (forks_busy()) return;
+            waiting = false;
+            next++;
+            continue;
+        }
+
+        CPlayback::action a = actions[next];
+        int64_t now = monotonic_ns();
+        int64_t deadline = start_ns + a.at_ns + shift_ns;
+        if (now < deadline) return;
+
+        int64_t late = now - deadline;
+        stats.actions++;
+        stats.total_ns += late;
+        if (late > stats.max_ns) stats.max_ns = late;
+
+        // the segment this action starts still gets its full planned time
+        if (late > REBASE_NS) {
+            shift_ns += late;
+            stats.rebased++;
+        }
+
+        if (a.type == CPlayback::FORKS_WAIT) {
+            // the routine picks up again once the forks stop
+            waiting = true;
+            continue;
+        }
+
+        if (a.type == CPlayback::END) {
+            if (late > stats.end_ns) stats.end_ns = late;
+            next = actions.size();
+        } else {
+            next++;
+        }
+
+        execute(a);
+        if (!running || generation != routine) return;
+    }
+
+    finish(true);
+}
+
+void CSequencer::cancel() {
+    if (running) finish(false);
+}
+
+void CSequencer::finish(bool finished) {
+    running = false;
+    actions.clear();
+
+    // done may start the next routine, so take it out first
+    function<void(bool)> callback = done;
+    done = nullptr;
+    if (callback) callback(finished);
+}
+
+bool CSequencer::busy() const {
+    return running;
+}
+
+int CSequencer::next_due_ms(int limit_ms) const {
+    if (!running || next >= actions.size()) return limit_ms;
+
+    int64_t wait_ns = (int64_t)limit_ms * 1000000;
+
+    if (waiting) {
+        wait_ns = min(wait_ns, (int64_t)FORKS_POLL_MS * 1000000);
+    } else {
+        wait_ns = min(wait_ns, start_ns + actions[next].at_ns + shift_ns - monotonic_ns());
+    }
+
+    // rounds up, a wait of 0 ms for an action less than 1 ms off would spin until it is due
+    return wait_ns > 0 ? (int)((wait_ns + 999999) / 1000000) : 0;
+}
+
+CPlayback::timing_stats CSequencer::get_stats() const {
+    return stats;
+}
+
+void CSequencer::print_stats() const {
+    if (stats.actions == 0) return;
+
+    cout << "Routine timing: " << stats.actions << " actions, avg late " << stats.total_ns / (double)stats.actions / 1e6
+         << " ms, max late " << stats.max_ns / 1e6 << " ms, end drift " << stats.end_ns / 1e6 << " ms, "
+         << stats.rebased << " late enough to push the schedule back\n";
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include "CPlayback.h"
+#include <stdint.h>
+#include <vector>
+#include <functional>
+
+/**
+*
+* @brief Runs routines step by step from the input thread, without blocking it
+*
+* A routine is a list of timed actions, each due at a fixed offset from the
+* start of the routine. Fork moves run on the stepper thread, so the wheel
+* actions after a fork move carry on while the forks travel, and FORKS_WAIT
+* holds the routine until the forks stop. END finishes the routine. An action
+* that runs more than a few ms late, such as the one after a fork wait that
+* ran long, moves the rest of the routine back by as much, so the segments
+* after it keep their planned length.
+*
+* Nothing here sleeps. The owner calls poll whenever it wakes, and next_due
+* says how long it may sleep for, so input is still read while a routine runs
+* and cancel stops a routine between any two actions.
+*
+*/
+class CSequencer {
+public:
+	/** @brief CSequencer constructor
+	*
+	* @param execute Called for each action when it is due, on the thread that calls poll
+	* @param forks_busy Checks if the forks are still moving, for FORKS_WAIT
+	* @return nothing to return
+	*/
+	CSequencer(std::function<void(const CPlayback::action&)> execute, std::function<bool()> forks_busy);
+
+	/** @brief Starts a routine. Its first actions run on the next poll
+	*
+	* @param actions The actions, in deadline order
+	* @param done Called once when the routine ends, with true if it finished and false if it was cancelled
+	* @return Returns a bool. (True --> Started) (False --> A routine is already running)
+	*/
+	bool start(const std::vector<CPlayback::action>& actions, std::function<void(bool)> done = nullptr);
+
+	/** @brief Runs every action that is due. Never blocks
+	*
+	* @return nothing to return
+	*/
+	void poll();
+
+	/** @brief Drops the routine that is running and calls its done with false
+	*
+	* @return nothing to return
+	*/
+	void cancel();
+
+	/** @brief Checks if a routine is running
+	*
+	* @return Returns a bool. (True --> Running) (False --> Idle)
+	*/
+	bool busy() const;
+
+	/** @brief Gets how long the owner may sleep before the next poll
+	*
+	* @param limit_ms The longest sleep the owner wants
+	* @return Returns the time to sleep in ms, up to limit_ms. Short while the routine waits on the forks
+	*/
+	int next_due_ms(int limit_ms) const;
+
+	/** @brief Gets how late the actions of the last routine ran
+	*
+	* @return Returns the timing stats
+	*/
+	CPlayback::timing_stats get_stats() const;
+
+	/** @brief Prints how late the actions of the last routine ran
+	*
+	* @return nothing to return
+	*/
+	void print_stats() const;
+
+private:
+	/** @brief Ends the routine and calls its done
+	*
+	* @param finished True if the routine reached its end
+	* @return nothing to return
+	*/
+	void finish(bool finished);
+
+    std::function<void(const CPlayback::action&)> execute;
+    std::function<bool()> forks_busy;
+    std::function<void(bool)> done;
+    std::vector<CPlayback::action> actions;
+    size_t next;
+    bool waiting;     // held on FORKS_WAIT
+    int64_t shift_ns; // how far late actions have pushed the rest of the routine back
+    int64_t start_ns;
+    unsigned generation; // counts routines, so poll can tell if execute started a new one
+    bool running;
+    CPlayback::timing_stats stats;
+};
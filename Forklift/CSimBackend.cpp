@@ -0,0 +1,287 @@
+#include "CSimBackend.h"
+#include <iostream>
+#include <fstream>
+#include <stdlib.h>
+
+using namespace std;
+
+// pigpio's sample clock, the CPigpioBackend default
+static const int SAMPLE_US = 10;
+
+// DMA PWM frequencies pigpio offers with a 1 us sample clock, slower clocks divide them
+static const int PWM_FREQUENCIES[] = {40000, 20000, 10000, 8000, 5000, 4000, 2500, 2000, 1600, 1250, 1000, 800, 500, 400, 250, 200, 100, 50};
+
+static const char* event_names[CSimBackend::EVENT_TYPES] = {"MODE", "EDGE", "PWM", "PWM_FREQUENCY", "SERVO", "SPI", "PWM_RANGE", "HARDWARE_PWM"};
+
+CSimBackend::CSimBackend(const string& log_path, size_t max_events) {
+    this->log_path = log_path;
+    this->max_events = max_events;
+    epoch = chrono::steady_clock::now();
+
+    for (int i = 0; i < 54; i++) {
+        levels[i] = 0;
+        modes[i] = INPUT;
+        duties[i] = 0;
+        ranges[i] = 255;
+        frequencies[i] = 800;
+    }
+
+    analog[0] = analog[1] = 0;
+    spi_used[0] = spi_used[1] = false;
+
+    for (int i = 0; i < EVENT_TYPES; i++) counts[i] = 0;
+}
+
+bool CSimBackend::initialise() {
+    return true;
+}
+
+void CSimBackend::terminate() {}
+
+long long CSimBackend::time_ns() const {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - epoch).count();
+}
+
+void CSimBackend::log(int type, int pin, int value) {
+    counts[type]++;
+
+    if (log_events.size() < max_events) {
+        event e = {time_ns(), type, pin, value};
+        log_events.push_back(e);
+    }
+}
+
+int CSimBackend::set_mode(int pin, int mode) {
+    if (pin < 0 || pin >= 54) return -1;
+
+    lock_guard<mutex> guard(lock);
+    modes[pin] = mode;
+    log(MODE, pin, mode);
+
+    return 0;
+}
+
+int CSimBackend::read(int pin) {
+    if (pin < 0 || pin >= 54) return -1;
+
+    lock_guard<mutex> guard(lock);
+    return levels[pin];
+}
+
+int CSimBackend::write(int pin, int level) {
+    if (pin < 0 || pin >= 54) return -1;
+
+    lock_guard<mutex> guard(lock);
+    level = level != 0;
+
+    // pigpio stops PWM on a pin that is written
+    duties[pin] = 0;
+
+    // only real edges are logged, like a logic analyser would see them
+    if (levels[pin] != level) log(EDGE, pin, level);
+    levels[pin] = level;
+
+    return 0;
+}
+
+int CSimBackend::write_bits_clear(unsigned int bits) {
+    lock_guard<mutex> guard(lock);
+
+    for (int pin = 0; pin < 32; pin++) {
+        if (!(bits & (1u << pin)) || levels[pin] == 0) continue;
+        levels[pin] = 0;
+        log(EDGE, pin, 0);
+    }
+
+    return 0;
+}
+
+int CSimBackend::write_bits_set(unsigned int bits) {
+    lock_guard<mutex> guard(lock);
+
+    for (int pin = 0; pin < 32; pin++) {
+        if (!(bits & (1u << pin)) || levels[pin] == 1) continue;
+        levels[pin] = 1;
+        log(EDGE, pin, 1);
+    }
+
+    return 0;
+}
+
+int CSimBackend::pwm(int pin, int duty) {
+    if (pin < 0 || pin >= 54 || duty < 0) return -1;
+
+    lock_guard<mutex> guard(lock);
+    if (duty > ranges[pin]) return -1;
+
+    duties[pin] = duty;
+    log(PWM, pin, duty);
+
+    return 0;
+}
+
+int CSimBackend::set_pwm_frequency(int pin, int frequency) {
+    if (pin < 0 || pin >= 54 || frequency < 0) return -1;
+
+    // like pigpio, DMA PWM only has the frequencies its sample clock divides into
+    int picked = PWM_FREQUENCIES[0] / SAMPLE_US;
+    for (size_t i = 0; i < sizeof(PWM_FREQUENCIES) / sizeof(PWM_FREQUENCIES[0]); i++) {
+        int f = PWM_FREQUENCIES[i] / SAMPLE_US;
+        if (abs(f - frequency) < abs(picked - frequency)) picked = f;
+    }
+
+    lock_guard<mutex> guard(lock);
+    frequencies[pin] = picked;
+    log(PWM_FREQUENCY, pin, picked);
+
+    // pigpio returns the frequency it picked
+    return picked;
+}
+
+int CSimBackend::set_pwm_range(int pin, int range) {
+    if (pin < 0 || pin >= 54 || range < 25 || range > 40000) return -1;
+
+    lock_guard<mutex> guard(lock);
+    ranges[pin] = range;
+    log(PWM_RANGE, pin, range);
+
+    return range;
+}
+
+int CSimBackend::get_pwm_real_range(int pin) {
+    if (pin < 0 || pin >= 54) return -1;
+
+    // one step per sample in each period
+    lock_guard<mutex> guard(lock);
+    return 1000000 / SAMPLE_US / frequencies[pin];
+}
+
+int CSimBackend::hardware_pwm(int pin, int frequency, int duty) {
+    // only these pins are wired to the PWM peripheral
+    if (pin != 12 && pin != 13 && pin != 18 && pin != 19) return -1;
+    if (duty < 0 || duty > 1000000) return -1;
+
+    lock_guard<mutex> guard(lock);
+    duties[pin] = duty;
+    log(HARDWARE_PWM, pin, duty);
+
+    return 0;
+}
+
+int CSimBackend::servo(int pin, int pulse_us) {
+    if (pin < 0 || pin >= 54) return -1;
+
+    lock_guard<mutex> guard(lock);
+    log(SERVO, pin, pulse_us);
+
+    return 0;
+}
+
+int CSimBackend::spi_open(int channel, int baud, int flags) {
+    if (channel < 0 || channel > 1) return -1;
+
+    lock_guard<mutex> guard(lock);
+    spi_used[channel] = true;
+
+    // the handle is the chip select
+    return channel;
+}
+
+int CSimBackend::spi_xfer(int handle, char* tx, char* rx, int count) {
+    if (handle < 0 || handle > 1 || count < 3) return -1;
+
+    lock_guard<mutex> guard(lock);
+    if (!spi_used[handle]) return -1;
+
+    // MCP3002: start bit, then 0b1XXX0000 where bit 4 is the channel, answer in the low 10 bits
+    int channel = (tx[1] >> 4) & 1;
+    int value = analog[channel];
+
+    rx[0] = 0;
+    rx[1] = (value >> 8) & 3;
+    rx[2] = value & 0xFF;
+    for (int i = 3; i < count; i++) rx[i] = 0;
+
+    log(SPI, handle, count);
+
+    return count;
+}
+
+int CSimBackend::spi_close(int handle) {
+    if (handle < 0 || handle > 1) return -1;
+
+    lock_guard<mutex> guard(lock);
+    if (!spi_used[handle]) return -1;
+    spi_used[handle] = false;
+
+    return 0;
+}
+
+void CSimBackend::print_summary() {
+    lock_guard<mutex> guard(lock);
+
+    cout << "Simulated backend:";
+    for (int i = 0; i < EVENT_TYPES; i++) cout << " " << event_names[i] << " " << counts[i];
+    cout << "\n";
+
+    if (!log_events.empty()) {
+        cout << "Event log: " << log_events.size() << " events over "
+             << (log_events.back().time_ns - log_events.front().time_ns) / 1e9 << " s\n";
+    }
+
+    if (log_path.empty()) return;
+
+    // time_ns, event, pin, value
+    ofstream outfile(log_path.c_str());
+    for (size_t i = 0; i < log_events.size(); i++) {
+        const event& e = log_events[i];
+        outfile << e.time_ns << " " << event_names[e.type] << " " << e.pin << " " << e.value << "\n";
+    }
+}
+
+void CSimBackend::set_analog(int channel, int value) {
+    if (channel < 0 || channel > 1) return;
+
+    lock_guard<mutex> guard(lock);
+    analog[channel] = value & 0x3FF;
+}
+
+void CSimBackend::set_input(int pin, int level) {
+    if (pin < 0 || pin >= 54) return;
+
+    lock_guard<mutex> guard(lock);
+    levels[pin] = level != 0;
+}
+
+int CSimBackend::level(int pin) const {
+    if (pin < 0 || pin >= 54) return 0;
+
+    lock_guard<mutex> guard(lock);
+    return levels[pin];
+}
+
+int CSimBackend::duty(int pin) const {
+    if (pin < 0 || pin >= 54) return 0;
+
+    lock_guard<mutex> guard(lock);
+    return duties[pin];
+}
+
+vector<CSimBackend::event> CSimBackend::events() const {
+    lock_guard<mutex> guard(lock);
+    return log_events;
+}
+
+unsigned long CSimBackend::count(int type) const {
+    if (type < 0 || type >= EVENT_TYPES) return 0;
+
+    lock_guard<mutex> guard(lock);
+    return counts[type];
+}
+
+void CSimBackend::clear() {
+    lock_guard<mutex> guard(lock);
+
+    log_events.clear();
+    for (int i = 0; i < EVENT_TYPES; i++) counts[i] = 0;
+}
@@ -0,0 +1,138 @@
+#pragma once
+#include "CBackend.h"
+#include <vector>
+#include <string>
+#include <mutex>
+#include <chrono>
+
+/**
+*
+* @brief In-process CBackend that simulates the pins, PWM and the MCP3002 ADC
+*
+* Every pin edge, mode change, PWM setting and SPI transfer is timestamped
+* with a monotonic clock and kept in an event log, so command latency and
+* call counts can be measured without a Pi. Safe to call from several threads.
+*
+*/
+class CSimBackend : public CBackend {
+public:
+	/**
+	* @brief kinds of logged events
+	*/
+	enum event_type{MODE = 0, EDGE, PWM, PWM_FREQUENCY, SERVO, SPI, PWM_RANGE, HARDWARE_PWM, EVENT_TYPES};
+
+	/**
+	* @brief one logged call. time_ns is measured from the backend's construction
+	*/
+	struct event {
+		long long time_ns;
+		int type;
+		int pin;   // SPI channel for SPI events
+		int value; // level, duty, frequency, pulse width or bytes transferred
+	};
+
+	/** @brief CSimBackend constructor
+	*
+	* @param log_path File the event log is written to by print_summary. Empty to not write one
+	* @param max_events Events kept in the log. Later events are still counted
+	* @return nothing to return
+	*/
+	CSimBackend(const std::string& log_path = "", size_t max_events = 1000000);
+
+	bool initialise();
+	void terminate();
+
+	int set_mode(int pin, int mode);
+	int read(int pin);
+	int write(int pin, int level);
+	int write_bits_clear(unsigned int bits);
+	int write_bits_set(unsigned int bits);
+
+	int pwm(int pin, int duty);
+	int set_pwm_frequency(int pin, int frequency);
+	int set_pwm_range(int pin, int range);
+	int get_pwm_real_range(int pin);
+	int hardware_pwm(int pin, int frequency, int duty);
+	int servo(int pin, int pulse_us);
+
+	int spi_open(int channel, int baud, int flags);
+	int spi_xfer(int handle, char* tx, char* rx, int count);
+	int spi_close(int handle);
+
+	/** @brief Prints the call counts and writes the event log if a path was given
+	*
+	* @return nothing to return
+	*/
+	void print_summary();
+
+	/** @brief Sets the value the simulated MCP3002 returns for a channel
+	*
+	* @param channel 0 or 1
+	* @param value 10 bit reading
+	* @return nothing to return
+	*/
+	void set_analog(int channel, int value);
+
+	/** @brief Drives a simulated input pin, as if something external changed it
+	*
+	* @param pin The BCM pin number
+	* @param level 0 or 1
+	* @return nothing to return
+	*/
+	void set_input(int pin, int level);
+
+	int level(int pin) const;
+	/** @brief Gets the duty cycle of a pin, in its PWM range or in millionths for hardware PWM
+	*
+	* @param pin The BCM pin number
+	* @return Returns the duty cycle
+	*/
+	int duty(int pin) const;
+
+	/** @brief Gets the time on the clock the event log uses
+	*
+	* @return Returns nanoseconds since the backend was constructed
+	*/
+	long long time_ns() const;
+
+	/** @brief Gets a copy of the event log
+	*
+	* @return Returns the logged events, oldest first
+	*/
+	std::vector<event> events() const;
+
+	/** @brief Gets the number of calls made of one kind, including ones past max_events
+	*
+	* @param type An event_type
+	* @return Returns the call count
+	*/
+	unsigned long count(int type) const;
+
+	/** @brief Clears the event log and call counts
+	*
+	* @return nothing to return
+	*/
+	void clear();
+
+private:
+	/** @brief Adds an event to the log. Must be called with lock held
+	*
+	* @return nothing to return
+	*/
+	void log(int type, int pin, int value);
+
+    mutable std::mutex lock;
+    std::chrono::steady_clock::time_point epoch;
+    std::string log_path;
+    size_t max_events;
+    std::vector<event> log_events;
+    unsigned long counts[EVENT_TYPES];
+
+    int levels[54];
+    int modes[54];
+    int duties[54];
+    int ranges[54];
+    int frequencies[54]; // DMA PWM frequency picked for each pin
+    int analog[2];
+    bool spi_used[2];
+};
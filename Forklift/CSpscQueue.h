@@ -0,0 +1,73 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include <stddef.h>
+
+/**
+*
+* @brief Lock-free queue for one producer thread and one consumer thread
+*
+* push and pop never block or allocate, so the producer can be a control
+* thread that must not stall. When the queue is full push fails and the
+* caller decides whether to drop the item.
+*
+*/
+template <typename T>
+class CSpscQueue {
+public:
+	/** @brief CSpscQueue constructor
+	*
+	* @param capacity Number of items the queue holds. Rounded up to a power of 2
+	* @return nothing to return
+	*/
+	CSpscQueue(size_t capacity) : head(0), tail(0) {
+		size_t size = 2;
+		while (size < capacity) size *= 2;
+
+		items.resize(size);
+		mask = size - 1;
+	}
+
+	/** @brief Adds an item. Only call from the producer thread
+	*
+	* @param item The item to add
+	* @return Returns a bool. (True --> Item added) (False --> Queue full)
+	*/
+	bool push(const T& item) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) > mask) return false;
+
+		items[t & mask] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** @brief Removes the oldest item. Only call from the consumer thread
+	*
+	* @param item The variable the item is stored in
+	* @return Returns a bool. (True --> Item removed) (False --> Queue empty)
+	*/
+	bool pop(T& item) {
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return false;
+
+		item = items[h & mask];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	/** @brief Checks if the queue is empty. Exact only on the consumer thread
+	*
+	* @return Returns a bool. (True --> Empty) (False --> Items waiting)
+	*/
+	bool empty() const {
+		return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+	}
+
+private:
+    std::vector<T> items;
+    size_t mask;
+    // kept on separate cache lines so the two threads don't fight over them
+    alignas(64) std::atomic<size_t> head; // next item to pop, written by the consumer
+    alignas(64) std::atomic<size_t> tail; // next slot to push, written by the producer
+};
@@ -0,0 +1,206 @@
+#include "CTelemetry.h"
+#include <atomic>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+static const char MAGIC[4] = {'F', 'K', 'T', 'L'};
+static const uint32_t VERSION = 1;
+
+static const int WORDS = sizeof(CTelemetry::state) / 4;
+
+static_assert(sizeof(CTelemetry::state) == 72, "state layout is shared with readers");
+static_assert(sizeof(CTelemetry::state) % 4 == 0, "a state is copied a word at a time");
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "atomics in shared memory have to be lock free");
+
+// the state is copied through relaxed atomic words, so a reader racing the writer reads torn
+// words rather than undefined behaviour, and the sequence number tells it to throw them away
+struct CTelemetry::block {
+    char magic[4];
+    uint32_t version;
+    uint32_t state_size;
+    uint32_t slots;
+    atomic<uint32_t> head;       // records published
+    atomic<int32_t> writer_pid;  // 0 once the writer has closed
+
+    struct slot {
+        atomic<uint32_t> seq;    // odd while being written
+        atomic<uint32_t> words[WORDS];
+    } ring[SLOTS];
+};
+
+// sequence number of a slot once record n is in it, every lap of the ring writes each slot once
+static uint32_t written_seq(uint32_t n) {
+    return 2 * (n / CTelemetry::SLOTS) + 2;
+}
+
+CTelemetry::CTelemetry() {
+    shared = NULL;
+    writer = false;
+    published = 0;
+    cursor = 0;
+    lost = 0;
+}
+
+CTelemetry::~CTelemetry() {
+    close();
+}
+
+bool CTelemetry::map(const string& name, bool writer) {
+    close();
+
+    int fd = shm_open(name.c_str(), writer ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (fd < 0) return false;
+
+    struct stat st;
+    bool ok = true;
+    if (writer) ok = ftruncate(fd, sizeof(block)) == 0;
+    else ok = fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(block);
+
+    void* p = MAP_FAILED;
+    if (ok) p = mmap(NULL, sizeof(block), writer ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+
+    // the mapping keeps the object open
+    ::close(fd);
+    if (p == MAP_FAILED) return false;
+
+    shared = (block*)p;
+    this->writer = writer;
+    return true;
+}
+
+bool CTelemetry::create(const string& name) {
+    if (!map(name, true)) return false;
+
+    // a block left by an earlier run starts again from empty, readers still attached to it see the restart
+    shared->writer_pid = 0;
+    shared->head.store(0, memory_order_release);
+    for (int i = 0; i < SLOTS; i++) shared->ring[i].seq.store(0, memory_order_relaxed);
+
+    memcpy(shared->magic, MAGIC, sizeof(MAGIC));
+    shared->version = VERSION;
+    shared->state_size = sizeof(state);
+    shared->slots = SLOTS;
+    shared->writer_pid.store(getpid(), memory_order_release);
+
+    published = 0;
+
+    // fault the pages in now rather than on the first few ticks
+    mlock(shared, sizeof(block));
+    return true;
+}
+
+bool CTelemetry::attach(const string& name) {
+    if (!map(name, false)) return false;
+
+    if (memcmp(shared->magic, MAGIC, sizeof(MAGIC)) != 0 || shared->version != VERSION ||
+        shared->state_size != sizeof(state) || shared->slots != SLOTS) {
+        close();
+        return false;
+    }
+
+    cursor = shared->head.load(memory_order_acquire);
+    lost = 0;
+    return true;
+}
+
+void CTelemetry::close() {
+    if (shared == NULL) return;
+
+    if (writer) shared->writer_pid.store(0, memory_order_release);
+
+    munmap(shared, sizeof(block));
+    shared = NULL;
+    writer = false;
+}
+
+void CTelemetry::publish(const state& s) {
+    if (shared == NULL || !writer) return;
+
+    block::slot& slot = shared->ring[published % SLOTS];
+    uint32_t seq = slot.seq.load(memory_order_relaxed);
+
+    // odd before any word changes, so a reader that sees a changed word also sees the slot as busy
+    slot.seq.store(seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    uint32_t words[WORDS];
+    memcpy(words, &s, sizeof(s));
+    for (int i = 0; i < WORDS; i++) slot.words[i].store(words[i], memory_order_relaxed);
+
+    slot.seq.store(seq + 2, memory_order_release);
+    shared->head.store(++published, memory_order_release);
+}
+
+bool CTelemetry::read_slot(uint32_t n, state& s) const {
+    const block::slot& slot = shared->ring[n % SLOTS];
+    uint32_t expected = written_seq(n);
+
+    if (slot.seq.load(memory_order_acquire) != expected) return false;
+
+    uint32_t words[WORDS];
+    for (int i = 0; i < WORDS; i++) words[i] = slot.words[i].load(memory_order_relaxed);
+
+    // the copy has to be finished before the sequence number is checked again
+    atomic_thread_fence(memory_order_acquire);
+    if (slot.seq.load(memory_order_relaxed) != expected) return false;
+
+    memcpy(&s, words, sizeof(s));
+    return true;
+}
+
+bool CTelemetry::latest(state& s) const {
+    if (shared == NULL) return false;
+
+    // only fails if the writer laps the ring while we copy, so a few tries is plenty
+    for (int tries = 0; tries < 4; tries++) {
+        uint32_t head = shared->head.load(memory_order_acquire);
+        if (head == 0) return false;
+        if (read_slot(head - 1, s)) return true;
+    }
+
+    return false;
+}
+
+bool CTelemetry::next(state& s) {
+    if (shared == NULL) return false;
+
+    while (true) {
+        uint32_t head = shared->head.load(memory_order_acquire);
+        int32_t behind = (int32_t)(head - cursor);
+
+        // the writer started again
+        if (behind < 0) cursor = head;
+        if (behind <= 0) return false;
+
+        if (behind > SLOTS) {
+            lost += behind - SLOTS;
+            cursor = head - SLOTS;
+        }
+
+        bool ok = read_slot(cursor, s);
+        cursor++;
+        if (ok) return true;
+
+        // overwritten before we got to it
+        lost++;
+    }
+}
+
+bool CTelemetry::writer_running() const {
+    if (shared == NULL) return false;
+
+    // a writer that crashed never cleared its pid
+    int32_t pid = shared->writer_pid.load(memory_order_acquire);
+    return pid > 0 && (kill(pid, 0) == 0 || errno == EPERM);
+}
+
+unsigned long CTelemetry::get_lost() const {
+    return lost;
+}
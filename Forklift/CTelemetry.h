@@ -0,0 +1,143 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+
+/**
+*
+* @brief Publishes the forklift's state to other processes through shared memory
+*
+* The input thread writes one state per control tick into a ring of slots in
+* a POSIX shared memory object. Each slot is a seqlock: its sequence number is
+* odd while the slot is being written, and goes up by two for every write.
+* Writing is a few dozen stores into memory the process already has mapped,
+* so it never makes a syscall and never waits on a reader. A reader copies a
+* slot and checks that the sequence number is the one that record should have,
+* and didn't change while it copied. If it did, the slot was overwritten and
+* the record is counted as lost. Readers never write to the block, so any
+* number of them can watch without the forklift knowing.
+*
+* A dashboard only wants the latest state, a logger wants every one. The ring
+* holds SLOTS ticks, so a logger that keeps up within that loses nothing.
+*
+*/
+class CTelemetry {
+public:
+	/**
+	* @brief what the forklift is busy with, in state::flags
+	*/
+	enum flags{IDLE = 1, ROUTINE = 2, APPROACH = 4, RECORDING = 8, CAPTURE = 16, FORKS_BUSY = 32, REMOTE = 64};
+
+	/**
+	* @brief states the ring holds, 1.28 s of control ticks
+	*/
+	enum{SLOTS = 128};
+
+	/**
+	* @brief the state published each control tick
+	*/
+	struct state {
+		uint32_t tick;             // control ticks since start
+		uint32_t flags;
+		int64_t time_ns;           // CLOCK_MONOTONIC time it was published
+		int32_t facing;            // RIGHT, FORWARD, LEFT or BACKWARD
+		int32_t dc;                // duty cycle of the last drive command out of 255, 0 once the wheels are off
+		int32_t wheel_duty[4];     // duty out of pwm_range, negative backward, 0 in standby
+		int32_t pwm_range;
+		int32_t fork_position[2];  // steps since startup, right then left
+		float adc[2];              // averaged readings in counts, -1 when not sampling
+		float battery_volts;       // 0 without a reading
+		float battery_gain;        // duty multiplier applied for the battery
+		uint32_t late_ticks;
+	};
+
+	/** @brief CTelemetry constructor
+	*
+	* @return nothing to return
+	*/
+	CTelemetry();
+
+	/** @brief CTelemetry destructor. Closes the block
+	*
+	* @return nothing to return
+	*/
+	~CTelemetry();
+
+	/** @brief Creates the shared memory block, or takes over the one a previous run left, and starts it empty
+	*
+	* @param name Name of the shared memory object
+	* @return Returns a bool. (True --> Ready to publish) (False --> The object could not be created or mapped)
+	*/
+	bool create(const std::string& name = "/forklift-telemetry");
+
+	/** @brief Maps the block a running forklift publishes to, read only
+	*
+	* @param name Name of the shared memory object
+	* @return Returns a bool. (True --> Attached) (False --> No block, or one from an incompatible version)
+	*/
+	bool attach(const std::string& name = "/forklift-telemetry");
+
+	/** @brief Unmaps the block. A writer marks it as stopped first, the last state stays readable
+	*
+	* @return nothing to return
+	*/
+	void close();
+
+	/** @brief Writes a state into the next slot. Never blocks. Only call from one thread of the writer
+	*
+	* @param s The state
+	* @return nothing to return
+	*/
+	void publish(const state& s);
+
+	/** @brief Gets the newest state
+	*
+	* @param s Set to the state
+	* @return Returns a bool. (True --> State read) (False --> Not attached, or nothing published yet)
+	*/
+	bool latest(state& s) const;
+
+	/** @brief Gets the oldest state this reader hasn't had yet, starting from the first one published after attach.
+	* States overwritten before they were read are skipped and counted as lost
+	*
+	* @param s Set to the state
+	* @return Returns a bool. (True --> State read) (False --> Not attached, or nothing new)
+	*/
+	bool next(state& s);
+
+	/** @brief Checks if the process that created the block is still running
+	*
+	* @return Returns a bool. (True --> Running) (False --> Not attached, closed or gone)
+	*/
+	bool writer_running() const;
+
+	/** @brief Gets the number of states next skipped because they were overwritten first
+	*
+	* @return Returns the count
+	*/
+	unsigned long get_lost() const;
+
+private:
+	struct block;
+
+	/** @brief Opens and maps the shared memory object
+	*
+	* @param name Name of the shared memory object
+	* @param writer Create it and map it for writing
+	* @return Returns a bool. (True --> Mapped) (False --> Could not be opened, sized or mapped)
+	*/
+	bool map(const std::string& name, bool writer);
+
+	/** @brief Copies one record out of its slot
+	*
+	* @param n Record number
+	* @param s Set to the state
+	* @return Returns a bool. (True --> Copied whole) (False --> The slot is being written or holds a newer record)
+	*/
+	bool read_slot(uint32_t n, state& s) const;
+
+    block* shared;
+    bool writer;
+    uint32_t published; // writer only
+    uint32_t cursor;    // next record a reader wants
+    unsigned long lost;
+};
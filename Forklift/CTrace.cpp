@@ -0,0 +1,202 @@
+#include "CTrace.h"
+
+#ifdef FORKLIFT_TRACE
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <stdio.h>
+#include <signal.h>
+#include <time.h>
+
+using namespace std;
+
+// 16 linear buckets per power of 2 up to 2^40 ns, about 18 minutes
+#define SUB_BITS 4
+#define SUB_BUCKETS (1 << SUB_BITS)
+#define BUCKETS ((40 - SUB_BITS + 2) * SUB_BUCKETS)
+
+static const char* STAGE_NAMES[CTrace::STAGES] = {"event_to_dispatch", "dispatch_to_set_data", "set_data_to_write", "event_to_write"};
+
+// histograms and the trace in progress for one thread. Only the owning thread writes
+// counts, so a relaxed load and store is enough and dump can read them at any time
+struct thread_trace {
+    atomic<uint64_t> counts[CTrace::STAGES][BUCKETS];
+    int64_t event_ns;
+    int64_t last_ns;      // time of the previous point
+    int64_t set_data_ns;
+    int64_t write_ns;     // last completed write, 0 if none yet
+    bool tracing;
+    bool set_data_seen;
+};
+
+static mutex threads_mutex;
+static vector<thread_trace*> threads; // never freed so a thread's counts outlive it
+static thread_local thread_trace* local = NULL;
+static atomic<bool> dump_requested(false);
+
+static thread_trace* get_trace() {
+    if (local != NULL) return local;
+
+    local = new thread_trace();
+    for (int s = 0; s < CTrace::STAGES; s++) {
+        for (int b = 0; b < BUCKETS; b++) local->counts[s][b].store(0, memory_order_relaxed);
+    }
+    local->tracing = false;
+
+    lock_guard<mutex> lock(threads_mutex);
+    threads.push_back(local);
+    return local;
+}
+
+static int64_t now_ns() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+static int bucket(int64_t ns) {
+    if (ns < SUB_BUCKETS) return ns < 0 ? 0 : (int)ns;
+
+    int power = 63 - __builtin_clzll((unsigned long long)ns);
+    if (power > 40) return BUCKETS - 1;
+
+    int sub = (int)(ns >> (power - SUB_BITS)) & (SUB_BUCKETS - 1);
+    return (power - SUB_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+// lowest value that lands in a bucket
+static int64_t bucket_floor(int b) {
+    if (b < SUB_BUCKETS) return b;
+
+    int power = b / SUB_BUCKETS + SUB_BITS - 1;
+    int sub = b % SUB_BUCKETS;
+    return (int64_t)(SUB_BUCKETS + sub) << (power - SUB_BITS);
+}
+
+static void count(thread_trace* t, int stage, int64_t ns) {
+    atomic<uint64_t>& c = t->counts[stage][bucket(ns)];
+    c.store(c.load(memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+void CTrace::event(int64_t event_ns) {
+    thread_trace* t = get_trace();
+    t->event_ns = event_ns;
+    t->last_ns = event_ns;
+    t->tracing = event_ns != 0;
+}
+
+void CTrace::dispatch() {
+    thread_trace* t = get_trace();
+    if (!t->tracing) return;
+
+    // only the first command an event dispatches is counted
+    int64_t now = now_ns();
+    count(t, EVENT_TO_DISPATCH, now - t->last_ns);
+    t->tracing = false;
+}
+
+void CTrace::resume(int64_t event_ns, int64_t dispatch_ns) {
+    thread_trace* t = get_trace();
+    t->event_ns = event_ns;
+    t->last_ns = dispatch_ns;
+    t->write_ns = 0;
+    t->set_data_seen = false;
+    t->tracing = event_ns != 0;
+}
+
+void CTrace::set_data() {
+    thread_trace* t = get_trace();
+    if (!t->tracing || t->set_data_seen) return;
+
+    int64_t now = now_ns();
+    count(t, DISPATCH_TO_SET_DATA, now - t->last_ns);
+    t->set_data_ns = now;
+    t->set_data_seen = true;
+}
+
+void CTrace::write_done() {
+    thread_trace* t = get_trace();
+    if (!t->tracing || !t->set_data_seen) return;
+
+    t->write_ns = now_ns();
+}
+
+void CTrace::finish() {
+    thread_trace* t = get_trace();
+    if (!t->tracing) return;
+
+    if (t->write_ns != 0) {
+        count(t, SET_DATA_TO_WRITE, t->write_ns - t->set_data_ns);
+        count(t, EVENT_TO_WRITE, t->write_ns - t->event_ns);
+    }
+    t->tracing = false;
+}
+
+static void request_dump(int) {
+    dump_requested = true;
+}
+
+void CTrace::install(int signal) {
+    ::signal(signal, request_dump);
+}
+
+void CTrace::poll(const string& path) {
+    if (dump_requested.exchange(false)) dump(path);
+}
+
+bool CTrace::dump(const string& path) {
+    static uint64_t merged[STAGES][BUCKETS];
+
+    {
+        lock_guard<mutex> lock(threads_mutex);
+
+        for (int s = 0; s < STAGES; s++) {
+            for (int b = 0; b < BUCKETS; b++) {
+                merged[s][b] = 0;
+                for (size_t i = 0; i < threads.size(); i++) merged[s][b] += threads[i]->counts[s][b].load(memory_order_relaxed);
+            }
+        }
+    }
+
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == NULL) return false;
+
+    fprintf(file, "# latency in ns. Buckets are [floor, next floor)\n");
+
+    for (int s = 0; s < STAGES; s++) {
+        uint64_t total = 0;
+        int top = 0;
+        for (int b = 0; b < BUCKETS; b++) {
+            total += merged[s][b];
+            if (merged[s][b] > 0) top = b;
+        }
+
+        fprintf(file, "stage %s count %llu", STAGE_NAMES[s], (unsigned long long)total);
+
+        if (total > 0) {
+            // each percentile is reported as the top of the bucket it falls in
+            const double percentiles[4] = {50, 90, 99, 99.9};
+            uint64_t seen = 0;
+            int p = 0;
+
+            for (int b = 0; b < BUCKETS && p < 4; b++) {
+                seen += merged[s][b];
+                while (p < 4 && seen >= percentiles[p] / 100 * total) {
+                    fprintf(file, " p%g %lld", percentiles[p], (long long)bucket_floor(b + 1));
+                    p++;
+                }
+            }
+            fprintf(file, " max %lld", (long long)bucket_floor(top + 1));
+        }
+        fprintf(file, "\n");
+
+        for (int b = 0; b < BUCKETS; b++) {
+            if (merged[s][b] > 0) fprintf(file, "%lld %llu\n", (long long)bucket_floor(b), (unsigned long long)merged[s][b]);
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+#endif
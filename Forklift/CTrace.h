@@ -0,0 +1,108 @@
+#pragma once
+#include <stdint.h>
+#include <string>
+
+/**
+*
+* @brief Latency tracepoints between a controller event and the GPIO writes it causes
+*
+* Four points are traced: the SDL event timestamp, dispatch of the command on the
+* SDL thread, entry to CControl::set_data and the last completed GPIO write of the
+* command. The time between consecutive points, and from the event to the last
+* write, goes into log-linear histograms (16 buckets per power of 2, so within about
+* 6%). Each thread counts into its own histograms without locks or atomic
+* read-modify-writes, and dump merges them.
+*
+* Tracing is only built with -DFORKLIFT_TRACE. Without it the TRACE_ macros are
+* empty and nothing here is compiled in.
+*
+*/
+class CTrace {
+public:
+	/**
+	* @brief intervals that are measured
+	*/
+	enum stage{EVENT_TO_DISPATCH = 0, DISPATCH_TO_SET_DATA, SET_DATA_TO_WRITE, EVENT_TO_WRITE, STAGES};
+
+	/** @brief Starts a trace on this thread at an SDL event
+	*
+	* @param event_ns CLOCK_MONOTONIC time of the event, 0 if the command has no event
+	* @return nothing to return
+	*/
+	static void event(int64_t event_ns);
+
+	/** @brief Marks the command being dispatched to the motor thread
+	*
+	* @return nothing to return
+	*/
+	static void dispatch();
+
+	/** @brief Picks up a trace on the motor thread, before the command runs
+	*
+	* @param event_ns Time of the event the command came from, 0 if there was none
+	* @param dispatch_ns Time the command was dispatched
+	* @return nothing to return
+	*/
+	static void resume(int64_t event_ns, int64_t dispatch_ns);
+
+	/** @brief Marks entry to CControl::set_data. Only the first call of a command is counted
+	*
+	* @return nothing to return
+	*/
+	static void set_data();
+
+	/** @brief Marks a GPIO write completing. The last one of a command is counted
+	*
+	* @return nothing to return
+	*/
+	static void write_done();
+
+	/** @brief Ends the trace on the motor thread once the command has run
+	*
+	* @return nothing to return
+	*/
+	static void finish();
+
+	/** @brief Makes a signal request a dump at the next poll
+	*
+	* @param signal The signal to catch
+	* @return nothing to return
+	*/
+	static void install(int signal);
+
+	/** @brief Dumps the histograms if the signal has been caught since the last poll
+	*
+	* @param path The file to write
+	* @return nothing to return
+	*/
+	static void poll(const std::string& path);
+
+	/** @brief Writes the histograms of every thread, merged, with percentiles for each stage
+	*
+	* @param path The file to write
+	* @return Returns a bool. (True --> File written) (False --> File could not be created)
+	*/
+	static bool dump(const std::string& path);
+};
+
+#ifdef FORKLIFT_TRACE
+#define TRACE_EVENT(event_ns) CTrace::event(event_ns)
+#define TRACE_DISPATCH() CTrace::dispatch()
+#define TRACE_RESUME(event_ns, dispatch_ns) CTrace::resume(event_ns, dispatch_ns)
+#define TRACE_SET_DATA() CTrace::set_data()
+#define TRACE_WRITE_DONE() CTrace::write_done()
+#define TRACE_FINISH() CTrace::finish()
+#define TRACE_INSTALL(signal) CTrace::install(signal)
+#define TRACE_POLL(path) CTrace::poll(path)
+#define TRACE_DUMP(path) CTrace::dump(path)
+#else
+#define TRACE_EVENT(event_ns) do {} while (0)
+#define TRACE_DISPATCH() do {} while (0)
+#define TRACE_RESUME(event_ns, dispatch_ns) do {} while (0)
+#define TRACE_SET_DATA() do {} while (0)
+#define TRACE_WRITE_DONE() do {} while (0)
+#define TRACE_FINISH() do {} while (0)
+#define TRACE_INSTALL(signal) do {} while (0)
+#define TRACE_POLL(path) do {} while (0)
+#define TRACE_DUMP(path) do {} while (0)
+#endif
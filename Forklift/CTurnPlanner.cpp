@@ -0,0 +1,54 @@
+#include "CTurnPlanner.h"
+
+using namespace std;
+
+// quarter turns from each heading to each other heading, anticlockwise positive. Half
+// turns go right from RIGHT and FORWARD and left from LEFT and BACKWARD
+static constexpr int QUARTERS[4][4] = {
+    // to RIGHT, FORWARD, LEFT, BACKWARD
+    { 0,  1, -2, -1},  // from RIGHT
+    {-1,  0,  1, -2},  // from FORWARD
+    { 2, -1,  0,  1},  // from LEFT
+    { 1,  2, -1,  0},  // from BACKWARD
+};
+
+// forward and sideways motion towards each heading
+static constexpr double MOTION[4][2] = {{0, 1}, {1, 0}, {0, -1}, {-1, 0}};
+
+CTurnPlanner::CTurnPlanner(int turn_90_ms, int turn_180_ms) {
+    set_durations(turn_90_ms, turn_180_ms);
+}
+
+void CTurnPlanner::set_durations(int turn_90_ms, int turn_180_ms) {
+    this->turn_90_ms = turn_90_ms;
+    this->turn_180_ms = turn_180_ms;
+}
+
+int CTurnPlanner::plan(int from, int to, double& omega) const {
+    omega = 0;
+
+    int quarters = quarter_turns(from, to);
+    if (quarters == 0) return 0;
+
+    // omega is clockwise, the table counts anticlockwise
+    omega = quarters > 0 ? -1 : 1;
+
+    return quarters == 2 || quarters == -2 ? turn_180_ms : turn_90_ms;
+}
+
+int CTurnPlanner::quarter_turns(int from, int to) {
+    if (from < RIGHT || from > BACKWARD || to < RIGHT || to > BACKWARD) return 0;
+    return QUARTERS[from][to];
+}
+
+bool CTurnPlanner::drive_motion(int dir, double& vx, double& vy) {
+    if (dir < RIGHT || dir > BACKWARD) {
+        vx = 0;
+        vy = 0;
+        return false;
+    }
+
+    vx = MOTION[dir][0];
+    vy = MOTION[dir][1];
+    return true;
+}
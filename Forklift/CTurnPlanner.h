@@ -0,0 +1,64 @@
+#pragma once
+
+/**
+*
+* @brief Plans the timed turns between the four headings the forklift drives in
+*
+* The forklift turns on the spot for a fixed time per quarter or half turn.
+* Headings go anticlockwise from RIGHT and match the DIRECTION values in
+* main, which drive segments also use for the way they move.
+*
+*/
+class CTurnPlanner {
+public:
+	/**
+	* @brief headings, anticlockwise. Also the direction of a drive segment
+	*/
+	enum heading{RIGHT = 0, FORWARD, LEFT, BACKWARD};
+
+	/** @brief CTurnPlanner constructor
+	*
+	* @param turn_90_ms Time a quarter turn takes in ms
+	* @param turn_180_ms Time a half turn takes in ms
+	* @return nothing to return
+	*/
+	CTurnPlanner(int turn_90_ms = 950, int turn_180_ms = 1875);
+
+	/** @brief Sets how long turns take
+	*
+	* @param turn_90_ms Time a quarter turn takes in ms
+	* @param turn_180_ms Time a half turn takes in ms
+	* @return nothing to return
+	*/
+	void set_durations(int turn_90_ms, int turn_180_ms);
+
+	/** @brief Plans the turn from one heading to another
+	*
+	* @param from Heading before the turn
+	* @param to Heading after the turn
+	* @param omega Set to the rotation to drive with, 1 clockwise or -1 anticlockwise
+	* @return Returns how long to turn for in ms, 0 if no turn is needed
+	*/
+	int plan(int from, int to, double& omega) const;
+
+	/** @brief Gets how far a turn from one heading to another goes
+	*
+	* @param from Heading before the turn
+	* @param to Heading after the turn
+	* @return Returns the quarter turns, anticlockwise positive. 0 if a heading isn't valid
+	*/
+	static int quarter_turns(int from, int to);
+
+	/** @brief Gets the motion that drives the forklift in a direction
+	*
+	* @param dir RIGHT, FORWARD, LEFT or BACKWARD
+	* @param vx Set to the forward speed, -1 to 1
+	* @param vy Set to the sideways speed to the right, -1 to 1
+	* @return Returns a bool. (True --> Motion set) (False --> Invalid direction)
+	*/
+	static bool drive_motion(int dir, double& vx, double& vy);
+
+private:
+    int turn_90_ms;
+    int turn_180_ms;
+};
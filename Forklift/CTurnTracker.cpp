@@ -0,0 +1,115 @@
+#include "CTurnTracker.h"
+#include <iostream>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+
+using namespace std;
+
+// fewest corners a frame is measured with
+static const size_t MIN_CORNERS = 6;
+
+static int64_t monotonic_ns() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+CTurnTracker::CTurnTracker(double fov_degrees, int width, int corners) {
+    fov = fov_degrees * M_PI / 180;
+    this->width = width;
+    max_corners = corners;
+    stats.frames = 0;
+    stats.lost = 0;
+    stats.step_sum = 0;
+    stats.step_max = 0;
+    reset();
+}
+
+void CTurnTracker::reset() {
+    yaw = 0;
+    tracked = 0;
+    previous.release();
+    previous_points.clear();
+}
+
+bool CTurnTracker::add(const cv::Mat& image) {
+    int64_t begin = monotonic_ns();
+    bool measured = false;
+
+    // shrink and grey into buffers kept from the last frame
+    double scale = (double)width / image.cols;
+    cv::resize(image, small, cv::Size(), scale, scale, cv::INTER_AREA);
+    if (small.channels() == 1) small.copyTo(gray);
+    else cv::cvtColor(small, gray, cv::COLOR_BGR2GRAY);
+
+    if (!previous.empty()) {
+        // top up the corners once too many have slid out of view
+        if (previous_points.size() < (size_t)max_corners / 2) {
+            cv::goodFeaturesToTrack(previous, previous_points, max_corners, 0.01, gray.cols / 20.0);
+        }
+
+        if (previous_points.size() >= MIN_CORNERS) {
+            cv::calcOpticalFlowPyrLK(previous, gray, previous_points, points, status, errors, cv::Size(15, 15), 2);
+
+            // bearing of a point is atan((x - centre) / focal length)
+            double centre = gray.cols / 2.0;
+            double focal = centre / tan(fov / 2);
+            size_t kept = 0;
+            turns.clear();
+
+            for (size_t i = 0; i < points.size(); i++) {
+                if (!status[i]) continue;
+
+                // the scene slides left as the forklift turns clockwise
+                turns.push_back(atan((previous_points[i].x - centre) / focal) - atan((points[i].x - centre) / focal));
+                points[kept++] = points[i];
+            }
+            points.resize(kept);
+
+            if (turns.size() >= MIN_CORNERS) {
+                nth_element(turns.begin(), turns.begin() + turns.size() / 2, turns.end());
+                yaw += turns[turns.size() / 2];
+                measured = true;
+            }
+
+            tracked = (int)turns.size();
+        }
+
+        // followed corners carry on to the next frame, lost tracking starts again from fresh corners
+        if (measured) {
+            previous_points.swap(points);
+        } else {
+            previous_points.clear();
+            stats.lost++;
+        }
+    }
+
+    cv::swap(previous, gray);
+
+    int64_t took = monotonic_ns() - begin;
+    stats.frames++;
+    stats.step_sum += took;
+    if (took > stats.step_max) stats.step_max = took;
+
+    return measured;
+}
+
+double CTurnTracker::get_yaw() const {
+    return yaw * 180 / M_PI;
+}
+
+int CTurnTracker::get_tracked() const {
+    return tracked;
+}
+
+CTurnTracker::tracker_stats CTurnTracker::get_stats() const {
+    return stats;
+}
+
+void CTurnTracker::print_stats() const {
+    if (stats.frames == 0) return;
+
+    cout << "Turn tracking: " << stats.frames << " frames, " << stats.lost << " lost, step avg "
+         << stats.step_sum / (double)stats.frames / 1e6 << " ms, max " << stats.step_max / 1e6 << " ms\n";
+}
@@ -0,0 +1,91 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <opencv2/opencv.hpp>
+
+/**
+*
+* @brief Measures how far the forklift has turned from what a forward camera sees
+*
+* While the forklift turns on the spot the scene slides sideways across the
+* image. Corners found in a small grey copy of each frame are followed to the
+* next frame with pyramidal Lucas-Kanade optical flow. The change in bearing of
+* each corner, worked out from its x position and the camera's field of view,
+* is how far the forklift turned between the frames. The median over the
+* corners ignores the few that were followed wrongly or that are on something
+* moving. Frames are kept small so one step fits inside a control tick.
+*
+*/
+class CTurnTracker {
+public:
+	/**
+	* @brief cost of each step, for checking it fits in the control tick
+	*/
+	struct tracker_stats {
+		unsigned long frames;
+		unsigned long lost;  // frames after the reference with too few corners followed to measure
+		int64_t step_sum;    // time spent in add
+		int64_t step_max;
+	};
+
+	/** @brief CTurnTracker constructor
+	*
+	* @param fov_degrees Horizontal field of view of the camera
+	* @param width Width frames are shrunk to before tracking
+	* @param corners Most corners followed at once
+	* @return nothing to return
+	*/
+	CTurnTracker(double fov_degrees = 62.2, int width = 160, int corners = 60);
+
+	/** @brief Starts measuring from zero. The next frame added is the reference
+	*
+	* @return nothing to return
+	*/
+	void reset();
+
+	/** @brief Adds the next frame and measures the turn since the one before
+	*
+	* @param image The frame, colour or grey, any size
+	* @return Returns a bool. (True --> Measured) (False --> Reference frame, or too few corners followed)
+	*/
+	bool add(const cv::Mat& image);
+
+	/** @brief Gets how far the forklift has turned since reset
+	*
+	* @return Returns the angle in degrees, clockwise positive
+	*/
+	double get_yaw() const;
+
+	/** @brief Gets how many corners the last frame was measured with
+	*
+	* @return Returns the number of corners
+	*/
+	int get_tracked() const;
+
+	/** @brief Gets the cost of each step since construction
+	*
+	* @return Returns the stats
+	*/
+	tracker_stats get_stats() const;
+
+	/** @brief Prints the cost of each step since construction
+	*
+	* @return nothing to return
+	*/
+	void print_stats() const;
+
+private:
+    double fov;  // radians
+    int width;
+    int max_corners;
+    double yaw;  // radians
+    int tracked;
+    tracker_stats stats;
+
+    // reused from frame to frame
+    cv::Mat small, gray, previous;
+    std::vector<cv::Point2f> previous_points, points;
+    std::vector<unsigned char> status;
+    std::vector<float> errors;
+    std::vector<double> turns;
+};
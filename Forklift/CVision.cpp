@@ -0,0 +1,241 @@
+#include "CVision.h"
+#include <iostream>
+#include <time.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <algorithm>
+
+using namespace std;
+
+// how long the detection thread waits for a frame before checking if it should stop
+static const int FRAME_WAIT_MS = 100;
+
+static int64_t monotonic_ns() {
+    timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+CVision::CVision(double scale, int dictionary) : scale(scale) {
+    set_roi(0, 0, 1, 1);
+    fps = 0;
+    paced = true;
+    searching = true;
+    frame_taken = false;
+    running = false;
+    capturing = false;
+    start_ns = 0;
+    stop_ns = 0;
+
+    this->dictionary = cv::aruco::getPredefinedDictionary(dictionary);
+    parameters = cv::makePtr<cv::aruco::DetectorParameters>();
+}
+
+CVision::~CVision() {
+    stop();
+}
+
+void CVision::set_roi(double x, double y, double width, double height) {
+    roi[0] = min(max(x, 0.0), 1.0);
+    roi[1] = min(max(y, 0.0), 1.0);
+    roi[2] = min(max(width, 0.0), 1.0 - roi[0]);
+    roi[3] = min(max(height, 0.0), 1.0 - roi[1]);
+}
+
+bool CVision::start(const string& source, bool paced, bool search) {
+    if (running) return false;
+
+    // a file that ended leaves its threads to be joined
+    stop();
+
+    // a number is a camera, anything else a file
+    char* end;
+    long camera = strtol(source.c_str(), &end, 10);
+    bool opened = !source.empty() && *end == '\0' ? this->source.open((int)camera) : this->source.open(source);
+    if (!opened) return false;
+
+    // cameras deliver frames at their own rate, only files need pacing
+    this->paced = paced && *end != '\0';
+    fps = this->source.get(cv::CAP_PROP_FPS);
+    if (fps <= 0) this->paced = false;
+
+    searching = search;
+    frame_taken = false;
+    frames.reset();
+    detections.reset();
+    captured = 0;
+    detected = 0;
+    detect_sum = 0;
+    detect_max = 0;
+    latency_sum = 0;
+    latency_max = 0;
+    start_ns = monotonic_ns();
+    stop_ns = 0;
+
+    running = true;
+    capturing = true;
+    capture_thread = thread(&CVision::capture_loop, this);
+    if (searching) detect_thread = thread(&CVision::detect_loop, this);
+    return true;
+}
+
+void CVision::stop() {
+    capturing = false;
+    if (capture_thread.joinable()) capture_thread.join();
+    if (detect_thread.joinable()) detect_thread.join();
+    if (source.isOpened()) source.release();
+}
+
+bool CVision::is_running() const {
+    return running;
+}
+
+bool CVision::is_searching() const {
+    return searching;
+}
+
+const CVision::detection* CVision::latest(int timeout_ms) {
+    if (!detections.take(timeout_ms)) return nullptr;
+    return &detections.front();
+}
+
+const CVision::frame* CVision::latest_frame(bool only_new) {
+    if (searching) return nullptr;
+
+    if (frames.take()) frame_taken = true;
+    else if (only_new) return nullptr;
+
+    return frame_taken ? &frames.front() : nullptr;
+}
+
+void CVision::capture_loop() {
+    unsigned long number = 0;
+
+    while (capturing) {
+        if (paced) {
+            // frame n is due n / fps after the start, like a camera running at the file's rate
+            int64_t deadline = start_ns + (int64_t)(number * 1e9 / fps);
+            timespec ts;
+            ts.tv_sec = deadline / 1000000000LL;
+            ts.tv_nsec = deadline % 1000000000LL;
+            while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR);
+        }
+
+        // read reuses the back buffer's pixels when the size doesn't change
+        frame& f = frames.back();
+        if (!source.read(f.image) || f.image.empty()) break;
+
+        f.captured_ns = monotonic_ns();
+        f.number = number++;
+        captured++;
+        frames.publish();
+    }
+
+    // the detection thread finishes the last frame and stops
+    frames.close();
+
+    if (!searching) {
+        stop_ns = monotonic_ns();
+        running = false;
+    }
+}
+
+void CVision::detect_loop() {
+    while (true) {
+        if (!frames.take(FRAME_WAIT_MS)) {
+            if (frames.is_closed()) break;
+            continue;
+        }
+
+        const frame& f = frames.front();
+        detection& d = detections.back();
+        detect(f, d);
+        detections.publish();
+    }
+
+    stop_ns = monotonic_ns();
+    running = false;
+    detections.close();
+}
+
+void CVision::detect(const frame& f, detection& d) {
+    int64_t begin = monotonic_ns();
+    int width = f.image.cols, height = f.image.rows;
+
+    cv::Rect area((int)(roi[0] * width), (int)(roi[1] * height), (int)(roi[2] * width), (int)(roi[3] * height));
+    area &= cv::Rect(0, 0, width, height);
+
+    d.frame = f.number;
+    d.captured_ns = f.captured_ns;
+    d.width = width;
+    d.height = height;
+    d.markers.clear();
+
+    if (area.width > 0 && area.height > 0) {
+        // a view of the region, shrunk and made grey in buffers kept from the last frame
+        cv::resize(f.image(area), scaled, cv::Size(), scale, scale, cv::INTER_AREA);
+        if (scaled.channels() == 1) scaled.copyTo(gray);
+        else cv::cvtColor(scaled, gray, cv::COLOR_BGR2GRAY);
+
+        cv::aruco::detectMarkers(gray, dictionary, corners, ids, parameters);
+
+        for (size_t i = 0; i < ids.size(); i++) {
+            const vector<cv::Point2f>& c = corners[i];
+            marker m = {ids[i], 0, 0, 0};
+
+            for (int k = 0; k < 4; k++) {
+                m.x += c[k].x / 4;
+                m.y += c[k].y / 4;
+                m.size += (float)cv::norm(c[(k + 1) % 4] - c[k]) / 4;
+            }
+
+            // back to full frame pixels
+            m.x = (float)(m.x / scale + area.x);
+            m.y = (float)(m.y / scale + area.y);
+            m.size = (float)(m.size / scale);
+            d.markers.push_back(m);
+        }
+    }
+
+    d.detected_ns = monotonic_ns();
+
+    int64_t took = d.detected_ns - begin, latency = d.detected_ns - f.captured_ns;
+    detected++;
+    detect_sum += took;
+    if (took > detect_max) detect_max = took;
+    latency_sum += latency;
+    if (latency > latency_max) latency_max = latency;
+}
+
+CVision::vision_stats CVision::get_stats() const {
+    vision_stats s;
+    s.captured = captured;
+    s.detected = detected;
+    s.dropped = s.captured - s.detected;
+    s.detect_sum = detect_sum;
+    s.detect_max = detect_max;
+    s.latency_sum = latency_sum;
+    s.latency_max = latency_max;
+
+    int64_t end = stop_ns != 0 ? (int64_t)stop_ns : monotonic_ns();
+    s.seconds = start_ns != 0 ? (end - start_ns) / 1e9 : 0;
+    return s;
+}
+
+void CVision::print_stats() const {
+    vision_stats s = get_stats();
+    if (s.seconds <= 0) return;
+
+    cout << "Vision: " << s.captured << " frames captured (" << s.captured / s.seconds << " fps)";
+    if (!searching) {
+        cout << "\n";
+        return;
+    }
+
+    cout << ", " << s.detected << " searched (" << s.detected / s.seconds << " fps), " << s.dropped << " dropped\n";
+    if (s.detected == 0) return;
+
+    cout << "Search time: avg " << s.detect_sum / (double)s.detected / 1e6 << " ms, max " << s.detect_max / 1e6
+         << " ms. Frame to detection: avg " << s.latency_sum / (double)s.detected / 1e6 << " ms, max "
+         << s.latency_max / 1e6 << " ms\n";
+}
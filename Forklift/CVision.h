@@ -0,0 +1,197 @@
+#pragma once
+#include "CLatestSlot.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <opencv2/opencv.hpp>
+#include <opencv2/aruco.hpp>
+
+/**
+*
+* @brief Finds the ArUco markers on pallets in camera frames, in the background
+*
+* Two threads feed whoever steers the forklift. The capture thread reads
+* frames and the detection thread searches a downscaled region of interest of
+* each one. Each stage hands its output on through a CLatestSlot, so the
+* buffers are reused and a slow stage only ever works on the newest frame.
+* The frames it skips count as dropped.
+*
+* Started without the search, the frames go to the caller instead, for
+* anything that needs every frame it can get, such as tracking a turn.
+*
+* The source can be a camera or a video file. A file is read at its own frame
+* rate, as a camera would deliver it, or as fast as it decodes, so throughput
+* and latency can be measured without the forklift.
+*
+*/
+class CVision {
+public:
+	/**
+	* @brief one marker, in full frame pixels
+	*/
+	struct marker {
+		int id;
+		float x, y;  // centre
+		float size;  // mean side length, grows as the forklift gets closer
+	};
+
+	/**
+	* @brief the markers found in one frame
+	*/
+	struct detection {
+		unsigned long frame;  // frame number from the start of the source
+		int64_t captured_ns;  // CLOCK_MONOTONIC time the frame was read
+		int64_t detected_ns;  // CLOCK_MONOTONIC time the search finished
+		int width, height;    // full frame size
+		std::vector<marker> markers;
+	};
+
+	/**
+	* @brief one frame as read
+	*/
+	struct frame {
+		cv::Mat image;
+		unsigned long number;  // from the start of the source
+		int64_t captured_ns;   // CLOCK_MONOTONIC time the frame was read
+	};
+
+	/**
+	* @brief throughput and latency since start
+	*/
+	struct vision_stats {
+		unsigned long captured;
+		unsigned long detected;
+		unsigned long dropped;   // frames the detection thread never saw
+		int64_t detect_sum;      // time spent searching frames
+		int64_t detect_max;
+		int64_t latency_sum;     // frame read to search finished
+		int64_t latency_max;
+		double seconds;          // start to stop, or to now while running
+	};
+
+	/** @brief CVision constructor
+	*
+	* @param scale How much the region of interest is shrunk before searching it
+	* @param dictionary The ArUco dictionary the pallet markers come from
+	* @return nothing to return
+	*/
+	CVision(double scale = 0.5, int dictionary = cv::aruco::DICT_4X4_50);
+
+	/** @brief CVision destructor. Stops the threads if they are still running
+	*
+	* @return nothing to return
+	*/
+	~CVision();
+
+	/** @brief Sets the part of each frame to search, as fractions of its width and height
+	*
+	* @param x Left edge
+	* @param y Top edge
+	* @param width Width
+	* @param height Height
+	* @return nothing to return
+	*/
+	void set_roi(double x, double y, double width, double height);
+
+	/** @brief Opens a source and starts the capture and detection threads
+	*
+	* @param source A camera number, or the path of a video file
+	* @param paced Read a file at its own frame rate instead of as fast as it decodes
+	* @param search Search frames for markers. Without it frames are left for latest_frame
+	* @return Returns a bool. (True --> Running) (False --> Already running or the source can't be opened)
+	*/
+	bool start(const std::string& source, bool paced = true, bool search = true);
+
+	/** @brief Stops the threads and closes the source
+	*
+	* @return nothing to return
+	*/
+	void stop();
+
+	/** @brief Checks if the threads are running
+	*
+	* @return Returns a bool. (True --> Running) (False --> Stopped, or a file has ended)
+	*/
+	bool is_running() const;
+
+	/** @brief Checks if frames are searched for markers or left for latest_frame
+	*
+	* @return Returns a bool. (True --> Searched) (False --> Left for latest_frame)
+	*/
+	bool is_searching() const;
+
+	/** @brief Gets the newest detection without waiting. Only call from one thread
+	*
+	* @param timeout_ms Longest wait for a new detection, 0 to only check
+	* @return Returns the detection, or nullptr if there is nothing newer than last time. Valid until the next call
+	*/
+	const detection* latest(int timeout_ms = 0);
+
+	/** @brief Gets the newest frame when started without the search. Only call from one thread
+	*
+	* @param only_new Give nothing back unless a frame came in since last time
+	* @return Returns the frame, or nullptr if there is none. Valid until the next call
+	*/
+	const frame* latest_frame(bool only_new = true);
+
+	/** @brief Gets the throughput and latency since start
+	*
+	* @return Returns the stats
+	*/
+	vision_stats get_stats() const;
+
+	/** @brief Prints the throughput and latency since start
+	*
+	* @return nothing to return
+	*/
+	void print_stats() const;
+
+private:
+	/** @brief Runs on the capture thread, reading frames until stopped or the file ends
+	*
+	* @return nothing to return
+	*/
+	void capture_loop();
+
+	/** @brief Runs on the detection thread, searching the newest frame each time
+	*
+	* @return nothing to return
+	*/
+	void detect_loop();
+
+	/** @brief Searches one frame
+	*
+	* @param f The frame
+	* @param d The detection to fill in
+	* @return nothing to return
+	*/
+	void detect(const frame& f, detection& d);
+
+    double scale;
+    double roi[4];
+    double fps;
+    bool paced;
+    bool searching;
+    bool frame_taken;  // latest_frame has a frame to give back
+    cv::VideoCapture source;
+    cv::Ptr<cv::aruco::Dictionary> dictionary;
+    cv::Ptr<cv::aruco::DetectorParameters> parameters;
+    CLatestSlot<frame> frames;
+    CLatestSlot<detection> detections;
+    std::thread capture_thread, detect_thread;
+    std::atomic<bool> running;
+    std::atomic<bool> capturing;
+
+    // detection thread only, reused from frame to frame
+    cv::Mat scaled, gray;
+    std::vector<int> ids;
+    std::vector<std::vector<cv::Point2f>> corners;
+
+    // written by the threads, read by get_stats
+    std::atomic<unsigned long> captured, detected;
+    std::atomic<int64_t> detect_sum, detect_max, latency_sum, latency_max;
+    int64_t start_ns;
+    std::atomic<int64_t> stop_ns;
+};
@@ -0,0 +1,117 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <signal.h>
+#include <unistd.h>
+
+#include "../CTelemetry.h"
+
+using namespace std;
+
+// Monitor shows the state a running Forklift publishes every control tick. It only reads
+// shared memory, so it can run alongside the forklift and never slows it down.
+//
+// Monitor          shows the latest state ten times a second
+// Monitor log      prints every state as a line of CSV, for piping into a file
+
+const useconds_t show_period_us = 100000;
+const useconds_t log_period_us = 50000; // well inside the 1.28 s the ring holds
+const int attach_retry_s = 1;
+
+volatile sig_atomic_t quit = 0;
+
+void on_signal(int) {
+    quit = 1;
+}
+
+const char* facing_name(int facing) {
+    static const char* names[4] = {"RIGHT", "FORWARD", "LEFT", "BACKWARD"};
+    return facing >= 0 && facing < 4 ? names[facing] : "?";
+}
+
+string flag_names(uint32_t flags) {
+    static const char* names[] = {"idle", "routine", "approach", "recording", "capture", "forks", "remote"};
+    string s;
+
+    for (int i = 0; i < 7; i++) {
+        if (!(flags & (1u << i))) continue;
+        if (!s.empty()) s += ",";
+        s += names[i];
+    }
+
+    return s.empty() ? "-" : s;
+}
+
+void show_state(const CTelemetry::state& s) {
+    cout << "\r" << fixed << setprecision(1)
+         << "tick " << s.tick << "  " << setw(8) << facing_name(s.facing)
+         << "  dc " << setw(3) << s.dc << "  wheels";
+    for (int i = 0; i < 4; i++) cout << " " << setw(5) << s.wheel_duty[i];
+    cout << " /" << s.pwm_range
+         << "  forks " << s.fork_position[0] << " " << s.fork_position[1]
+         << "  adc " << s.adc[0] << " " << s.adc[1]
+         << "  battery " << s.battery_volts << " V x" << setprecision(2) << s.battery_gain
+         << "  late " << s.late_ticks << "  " << flag_names(s.flags) << "      " << flush;
+}
+
+void log_header() {
+    cout << "tick,time_ns,facing,dc,wheel_fl,wheel_fr,wheel_bl,wheel_br,pwm_range,fork_right,fork_left,"
+         << "adc0,adc1,battery_volts,battery_gain,late_ticks,flags\n";
+}
+
+void log_state(const CTelemetry::state& s) {
+    cout << s.tick << "," << s.time_ns << "," << s.facing << "," << s.dc;
+    for (int i = 0; i < 4; i++) cout << "," << s.wheel_duty[i];
+    cout << "," << s.pwm_range << "," << s.fork_position[0] << "," << s.fork_position[1]
+         << "," << s.adc[0] << "," << s.adc[1] << "," << s.battery_volts << "," << s.battery_gain
+         << "," << s.late_ticks << "," << s.flags << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    bool logging = argc == 2 && string(argv[1]) == "log";
+
+    if (argc > 2 || (argc == 2 && !logging)) {
+        cout << "Usage: Monitor [log]\n";
+        return 1;
+    }
+
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+
+    CTelemetry telemetry;
+    CTelemetry::state s;
+    int64_t last_ns = -1;
+    bool stopped = false;
+
+    // progress messages go to stderr so a log stays plain CSV
+    while (!quit && !telemetry.attach()) {
+        cerr << "Waiting for Forklift to start\n";
+        sleep(attach_retry_s);
+    }
+
+    if (logging) log_header();
+
+    while (!quit) {
+        if (logging) {
+            while (telemetry.next(s)) log_state(s);
+            usleep(log_period_us);
+        } else {
+            if (telemetry.latest(s) && s.time_ns != last_ns) {
+                show_state(s);
+                last_ns = s.time_ns;
+            }
+            usleep(show_period_us);
+        }
+
+        // the last state stays in the block, say once that nothing new is coming
+        bool running = telemetry.writer_running();
+        if (!running && !stopped) cerr << "\nForklift stopped\n";
+        if (running && stopped) cerr << "\nForklift started again\n";
+        stopped = !running;
+    }
+
+    if (!logging) cout << "\n";
+    if (telemetry.get_lost() > 0) cerr << telemetry.get_lost() << " states lost, the reader fell behind\n";
+
+    return 0;
+}
@@ -0,0 +1,484 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <math.h>
+
+#include "../CTelemetry.h"
+#include "../CLatestSlot.h"
+#include "../CRemote.h"
+#include "../CAxisCapture.h"
+#include "../CTurnPlanner.h"
+#include "../CForkPlanner.h"
+#include "../CSimBackend.h"
+#include "../CPlanOptimiser.h"
+#include "../CKinematicSim.h"
+
+using namespace std;
+
+// Tests runs the stress and round trip checks for the parts of the forklift that other threads and
+// processes depend on. None of them touch the hardware, so they run anywhere.
+//
+// Tests            runs every check
+// Tests <name>     runs one: telemetry, telemetry-log, latest-slot, remote, capture or plan
+
+const string telemetry_name = "/forklift-telemetry-test";
+const uint32_t telemetry_publishes = 2000000;
+const int telemetry_log_ticks = 300;       // 3 s at the control tick
+const useconds_t control_tick_us = 10000;
+const useconds_t log_period_us = 50000;    // the same as Monitor log
+const int slot_items = 200000;
+const int remote_timeout_ms = 1000;
+const int capture_ticks = 100000;
+const string plan_recording = "../Recording.txt";
+const double plan_position_m = 0.05;     // how far apart the two plans may end
+const double plan_heading_deg = 5;
+
+// every word of a state follows from its tick, so a state mixed from two writes doesn't check out
+void fill_state(CTelemetry::state& s, uint32_t tick) {
+    s.tick = tick;
+    s.flags = tick * 3;
+    s.time_ns = (int64_t)tick * 10000000;
+    s.facing = tick % 4;
+    s.dc = tick % 256;
+    for (int i = 0; i < 4; i++) s.wheel_duty[i] = (int32_t)(tick + i);
+    s.pwm_range = ~tick;
+    s.fork_position[0] = (int32_t)tick;
+    s.fork_position[1] = -(int32_t)tick;
+    s.adc[0] = (float)(tick & 0xFFFF);
+    s.adc[1] = (float)(tick >> 16);
+    s.battery_volts = (float)(tick % 1000);
+    s.battery_gain = (float)(tick % 7);
+    s.late_ticks = tick ^ 0x5A5A5A5A;
+}
+
+bool state_whole(const CTelemetry::state& s) {
+    CTelemetry::state expected;
+    fill_state(expected, s.tick);
+    return memcmp(&s, &expected, sizeof(s)) == 0;
+}
+
+bool check(bool ok, const string& what) {
+    if (!ok) cout << "  FAILED: " << what << "\n";
+    return ok;
+}
+
+// a writer flat out against a dashboard and a logger, neither may ever see a torn state
+bool test_telemetry() {
+    CTelemetry writer;
+    if (!check(writer.create(telemetry_name), "create " + telemetry_name)) return false;
+
+    CTelemetry latest_reader, log_reader;
+    if (!check(latest_reader.attach(telemetry_name) && log_reader.attach(telemetry_name), "attach")) return false;
+
+    atomic<bool> writing(true);
+    unsigned long latest_got = 0, latest_torn = 0, log_got = 0, log_torn = 0, out_of_order = 0;
+
+    thread latest_thread([&]() {
+        CTelemetry::state s;
+        while (writing) {
+            if (!latest_reader.latest(s)) continue;
+            latest_got++;
+            if (!state_whole(s)) latest_torn++;
+        }
+    });
+
+    thread log_thread([&]() {
+        CTelemetry::state s;
+        uint32_t last = 0;
+        bool first = true;
+
+        // the writer may finish while there are still states to read
+        while (true) {
+            bool done = !writing;
+            while (log_reader.next(s)) {
+                log_got++;
+                if (!state_whole(s)) log_torn++;
+                if (!first && s.tick <= last) out_of_order++;
+                last = s.tick;
+                first = false;
+            }
+            if (done) break;
+        }
+    });
+
+    CTelemetry::state s;
+    int64_t begin = CRemote::now_ns();
+    for (uint32_t i = 1; i <= telemetry_publishes; i++) {
+        fill_state(s, i);
+        writer.publish(s);
+    }
+    int64_t took = CRemote::now_ns() - begin;
+
+    writing = false;
+    latest_thread.join();
+    log_thread.join();
+
+    writer.close();
+    shm_unlink(telemetry_name.c_str());
+
+    cout << "  " << telemetry_publishes << " publishes at " << took / (double)telemetry_publishes << " ns each, latest read "
+         << latest_got << " times, log read " << log_got << " and lost " << log_reader.get_lost() << "\n";
+
+    bool ok = check(latest_torn == 0, to_string(latest_torn) + " torn states from latest");
+    ok = check(log_torn == 0, to_string(log_torn) + " torn states from next") && ok;
+    ok = check(out_of_order == 0, to_string(out_of_order) + " states out of order from next") && ok;
+    ok = check(log_got + log_reader.get_lost() == telemetry_publishes, "read and lost states don't add up to the publishes") && ok;
+    return ok;
+}
+
+// a writer at the control tick and a reader polling like Monitor log has to see every tick
+bool test_telemetry_log() {
+    CTelemetry writer, reader;
+    if (!check(writer.create(telemetry_name), "create " + telemetry_name)) return false;
+    if (!check(reader.attach(telemetry_name), "attach")) return false;
+
+    atomic<bool> writing(true);
+    thread writer_thread([&]() {
+        CTelemetry::state s;
+        for (int i = 1; i <= telemetry_log_ticks; i++) {
+            fill_state(s, i);
+            writer.publish(s);
+            usleep(control_tick_us);
+        }
+        writing = false;
+    });
+
+    CTelemetry::state s;
+    uint32_t expected = 1;
+    unsigned long gaps = 0;
+
+    while (true) {
+        bool done = !writing;
+        while (reader.next(s)) {
+            if (s.tick != expected) gaps++;
+            expected = s.tick + 1;
+        }
+        if (done) break;
+        usleep(log_period_us);
+    }
+
+    writer_thread.join();
+    writer.close();
+    shm_unlink(telemetry_name.c_str());
+
+    cout << "  " << expected - 1 << " ticks logged, " << gaps << " gaps, " << reader.get_lost() << " lost\n";
+
+    bool ok = check(expected - 1 == (uint32_t)telemetry_log_ticks, "the log ended at tick " + to_string(expected - 1));
+    ok = check(gaps == 0 && reader.get_lost() == 0, "the log has gaps") && ok;
+    return ok;
+}
+
+// the consumer only sees newer items, each whole, and every item is either taken or dropped
+bool test_latest_slot() {
+    CLatestSlot<vector<int>> slot;
+    unsigned long taken = 0, torn = 0, backwards = 0;
+
+    thread consumer([&]() {
+        int last = 0;
+        while (true) {
+            // an item published before close can still be taken
+            if (!slot.take(10)) {
+                if (slot.is_closed() && !slot.take()) break;
+                continue;
+            }
+
+            const vector<int>& v = slot.front();
+            taken++;
+            for (size_t i = 1; i < v.size(); i++) {
+                if (v[i] != v[0]) {
+                    torn++;
+                    break;
+                }
+            }
+            if (v[0] <= last) backwards++;
+            last = v[0];
+        }
+    });
+
+    for (int i = 1; i <= slot_items; i++) {
+        vector<int>& v = slot.back();
+        v.assign(64, i);
+        slot.publish();
+    }
+    slot.close();
+    consumer.join();
+
+    cout << "  " << slot_items << " items published, " << taken << " taken, " << slot.get_dropped() << " dropped\n";
+
+    bool ok = check(torn == 0, to_string(torn) + " items changed while the consumer held them");
+    ok = check(backwards == 0, to_string(backwards) + " items older than one already taken") && ok;
+    ok = check(taken + slot.get_dropped() == (unsigned long)slot_items, "taken and dropped don't add up to the items") && ok;
+    return ok;
+}
+
+// waits for the receiver to have seen n datagrams, it runs on its own thread
+CRemote::remote_stats remote_wait(CRemote& server, unsigned long n) {
+    CRemote::remote_stats s = server.get_stats();
+
+    for (int waited = 0; waited < remote_timeout_ms; waited++) {
+        s = server.get_stats();
+        if (s.received + s.stale + s.malformed >= n) break;
+        usleep(1000);
+    }
+    return s;
+}
+
+// packets go through a real socket, so decode is checked the way the forklift sees them
+bool test_remote() {
+    string path = "/tmp/forklift-tests-" + to_string(getpid()) + ".sock";
+    CRemote server, client;
+
+    if (!check(server.open("unix:" + path, true) && server.start(nullptr), "open the server on " + path)) return false;
+    if (!check(client.open("unix:" + path, false), "open the client")) return false;
+
+    CRemote::header h;
+    memset(&h, 0, sizeof(h));
+    CRemote::command c;
+    unsigned long sent = 0, expect_received = 0, expect_malformed = 0;
+    bool ok = true;
+
+    // one command per packet, valid says whether decode should take it
+    struct sample {
+        uint8_t type;
+        int8_t channel;
+        int16_t value;
+        bool valid;
+    } samples[] = {
+        {CRemote::DRIVE, 0, 500, true},
+        {CRemote::TURN, 0, CTurnPlanner::RIGHT, true},
+        {CRemote::TURN, 0, CTurnPlanner::BACKWARD, true},
+        {CRemote::TURN, 0, CTurnPlanner::BACKWARD + 1, false},
+        {CRemote::TURN, 0, -1, false},
+        {CRemote::FORKS_TO, CForkPlanner::BOTH_FORKS, 100, true},
+        {CRemote::FORKS_TO, CForkPlanner::BOTH_FORKS + 1, 100, false},
+        {CRemote::FORKS_MOVE, -1, 1, false},
+        {CRemote::FORKS_STOP, 3, 0, false},
+        {CRemote::COMMAND_TYPES, 0, 0, false},
+    };
+
+    for (size_t i = 0; i < sizeof(samples) / sizeof(samples[0]); i++) {
+        memset(&c, 0, sizeof(c));
+        c.type = samples[i].type;
+        c.channel = samples[i].channel;
+        c.value[0] = samples[i].value;
+
+        h.seq++;
+        client.send(h, &c, 1);
+        sent++;
+        if (samples[i].valid) expect_received++;
+        else expect_malformed++;
+
+        CRemote::remote_stats s = remote_wait(server, sent);
+        ok = check(s.received == expect_received && s.malformed == expect_malformed,
+                   "command " + to_string(i) + " was " + (samples[i].valid ? "rejected" : "accepted")) && ok;
+    }
+
+    // cut short, and a header without the magic, straight onto the socket
+    int raw = socket(AF_UNIX, SOCK_DGRAM, 0);
+    sockaddr_un to;
+    memset(&to, 0, sizeof(to));
+    to.sun_family = AF_UNIX;
+    strcpy(to.sun_path, path.c_str());
+
+    uint8_t junk[sizeof(CRemote::header) + sizeof(CRemote::command)];
+    memset(junk, 0, sizeof(junk));
+    sendto(raw, junk, sizeof(CRemote::header) - 1, 0, (sockaddr*)&to, sizeof(to));
+    sendto(raw, junk, sizeof(junk), 0, (sockaddr*)&to, sizeof(to));
+    ::close(raw);
+    sent += 2;
+    expect_malformed += 2;
+
+    // after a good packet, a repeat of its sequence number is stale and a jump of three misses two
+    memset(&c, 0, sizeof(c));
+    c.type = CRemote::STOP;
+    h.seq++;
+    client.send(h, &c, 1);
+    sent++;
+    expect_received++;
+    CRemote::remote_stats before = remote_wait(server, sent);
+
+    client.send(h, &c, 1);
+    h.seq += 3;
+    client.send(h, &c, 1);
+    sent += 2;
+    expect_received++;
+
+    CRemote::remote_stats s = remote_wait(server, sent);
+    cout << "  " << s.received << " received, " << s.malformed << " malformed, " << s.stale << " stale, " << s.missed << " missed\n";
+
+    ok = check(s.malformed == expect_malformed, "bad datagrams not counted as malformed") && ok;
+    ok = check(s.received == expect_received, "good packets not all received") && ok;
+    ok = check(s.stale - before.stale == 1 && s.missed - before.missed == 2, "repeat and jump not counted") && ok;
+
+    // only valid packets reach the queue
+    CRemote::packet p;
+    unsigned long queued = 0;
+    while (server.receive(p)) queued++;
+    ok = check(queued == expect_received, "queued packets don't match the received count") && ok;
+
+    client.close();
+    server.close();
+    return ok;
+}
+
+// a random walk with jumps the length of the axis range, gaps that need multi byte varints, and buttons
+bool test_capture() {
+    const int axes = 6;
+    string path = "/tmp/forklift-tests-" + to_string(getpid()) + ".bin";
+    vector<CAxisCapture::frame> sent;
+    int16_t values[CAxisCapture::MAX_AXES] = {0, 0, 0, 0, 0, 0};
+    CAxisCapture capture;
+
+    srand(1);
+    values[0] = -32768;
+    values[1] = 32767;
+    if (!check(capture.open(path, axes, 10000, values), "open " + path)) return false;
+
+    CAxisCapture::frame f;
+    f.tick = 0;
+    f.changed = (1 << axes) - 1;
+    memcpy(f.values, values, sizeof(values));
+    sent.push_back(f);
+
+    uint32_t tick = 0;
+    for (int i = 0; i < capture_ticks; i++) {
+        int r = rand() % 100;
+        tick += r < 2 ? 200 + rand() % 20000 : 1;
+
+        vector<uint8_t> buttons;
+        f.changed = 0;
+        for (int a = 0; a < axes; a++) {
+            int change = rand() % 4;
+            if (change == 0) continue;
+            int v = change == 1 ? (rand() % 2 ? 32767 : -32768) : values[a] + rand() % 201 - 100;
+            if (v > 32767) v = 32767;
+            if (v < -32768) v = -32768;
+            if (v == values[a]) continue;
+            values[a] = (int16_t)v;
+            f.changed |= 1 << a;
+        }
+        if (r < 10) buttons.push_back((uint8_t)(rand() % 21));
+        if (r < 3) buttons.push_back((uint8_t)(rand() % 21));
+
+        capture.add(tick, values, buttons);
+        if (f.changed == 0 && buttons.empty()) continue;
+
+        f.tick = tick;
+        memcpy(f.values, values, sizeof(values));
+        f.buttons = buttons;
+        sent.push_back(f);
+    }
+
+    // a tick where nothing changed stores nothing
+    capture.add(tick + 1, values, vector<uint8_t>());
+    unsigned long frames = capture.frames();
+    size_t bytes = capture.bytes();
+    if (!check(capture.close(), "write " + path)) return false;
+
+    vector<CAxisCapture::frame> loaded;
+    uint32_t period_us = 0;
+    bool read = CAxisCapture::load(path, loaded, period_us);
+
+    // a file cut short is refused rather than read partly
+    struct stat st;
+    vector<CAxisCapture::frame> cut;
+    bool cut_read = stat(path.c_str(), &st) == 0 && truncate(path.c_str(), st.st_size - 1) == 0 && CAxisCapture::load(path, cut, period_us);
+    unlink(path.c_str());
+    if (!check(read, "load " + path)) return false;
+
+    cout << "  " << frames << " frames in " << bytes << " bytes over " << tick << " ticks\n";
+
+    bool ok = check(period_us == 10000, "period changed");
+    ok = check(frames == sent.size() && loaded.size() == sent.size(), "frame count changed") && ok;
+
+    size_t mismatched = 0;
+    for (size_t i = 0; i < loaded.size() && i < sent.size(); i++) {
+        bool same = loaded[i].tick == sent[i].tick && loaded[i].changed == sent[i].changed && loaded[i].buttons == sent[i].buttons;
+        for (int a = 0; a < axes; a++) same = same && loaded[i].values[a] == sent[i].values[a];
+        if (!same) mismatched++;
+    }
+    ok = check(mismatched == 0, to_string(mismatched) + " frames came back different") && ok;
+    ok = check(!cut_read, "a capture missing its last byte was read") && ok;
+    return ok;
+}
+
+bool test_plan() {
+    vector<CRecorder::record> records;
+    if (!check(CRecorder::load(plan_recording, records), "load " + plan_recording)) return false;
+
+    // the planners only need a CControl to time the fork moves, which the simulator gives them
+    CSimBackend sim;
+    CControl control(sim);
+    CForkPlanner forks(control);
+    CKinematicSim kinematics(forks);
+
+    CKinematicSim::job j = CKinematicSim::default_job(plan_recording);
+    CTurnPlanner turns(j.turn_90_ms, j.turn_180_ms);
+    CMixer mixer;
+    mixer.set_gain(2, CMixer::VY, j.strafe_gain);
+
+    vector<CPlayback::action> plain, optimised;
+    CPlayback(forks).compile(records, plain);
+    CPlanOptimiser optimiser(forks);
+    optimiser.compile(records, optimised);
+
+    CKinematicSim::result a = kinematics.simulate(plain, mixer, turns);
+    CKinematicSim::result b = kinematics.simulate(optimised, mixer, turns);
+
+    cout << "  " << plain.size() << " actions over " << a.cycle_s << " s, optimised " << optimised.size()
+         << " actions over " << b.cycle_s << " s\n";
+    cout << "  end (" << a.x << ", " << a.y << ") m at " << a.heading << " degrees, optimised (" << b.x << ", "
+         << b.y << ") m at " << b.heading << " degrees\n";
+
+    // the rewrite may only take time out, the forklift has to end up where the recording left it
+    bool ok = check(a.fork_height[0] == b.fork_height[0] && a.fork_height[1] == b.fork_height[1], "forks end at different heights");
+    ok = check(hypot(a.x - b.x, a.y - b.y) <= plan_position_m, "plans end more than " + to_string(plan_position_m) + " m apart") && ok;
+    ok = check(fabs(a.heading - b.heading) <= plan_heading_deg, "plans end facing different ways") && ok;
+    ok = check(b.cycle_s <= a.cycle_s, "optimised plan is longer") && ok;
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    struct test {
+        const char* name;
+        bool (*run)();
+    } tests[] = {
+        {"telemetry", test_telemetry},
+        {"telemetry-log", test_telemetry_log},
+        {"latest-slot", test_latest_slot},
+        {"remote", test_remote},
+        {"capture", test_capture},
+        {"plan", test_plan},
+    };
+    const int count = sizeof(tests) / sizeof(tests[0]);
+
+    string only = argc == 2 ? argv[1] : "";
+    int ran = 0, failed = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (!only.empty() && only != tests[i].name) continue;
+
+        cout << tests[i].name << "\n";
+        bool ok = tests[i].run();
+        cout << (ok ? "  ok\n" : "  FAILED\n");
+        ran++;
+        if (!ok) failed++;
+    }
+
+    if (argc > 2 || ran == 0) {
+        cout << "Usage: Tests [telemetry|telemetry-log|latest-slot|remote|capture|plan]\n";
+        return 1;
+    }
+
+    cout << ran - failed << " of " << ran << " passed\n";
+    return failed == 0 ? 0 : 1;
+}
@@ -1,40 +1,303 @@
 #include <iostream>
 #include <SDL.h>
 #include <SDL_gamecontroller.h>
-#include <map>
 #include <array>
 #include <fstream>
 #include <vector>
 #include <unistd.h>
 #include <chrono>
 #include <thread>
+#include <atomic>
+#include <math.h>
+#include <time.h>
+#include <signal.h>
+#include <errno.h>
+#include <string.h>
+#include <algorithm>
 
 #include <opencv2/opencv.hpp>
 
 #include "CControl.h"
+#include "CSimBackend.h"
+#include "CBatteryComp.h"
+#include "CForkPlanner.h"
+#include "CRecorder.h"
+#include "CPlayback.h"
+#include "CPlanOptimiser.h"
+#include "CKinematicSim.h"
+#include "CMixer.h"
+#include "CInputMap.h"
+#include "CTurnPlanner.h"
+#include "CMotorThread.h"
+#include "CTrace.h"
+#include "CAxisCapture.h"
+#include "CSequencer.h"
+#include "CVision.h"
+#include "CTurnTracker.h"
+#include "CRemote.h"
+#include "CTelemetry.h"
 
 using namespace cv;
 using namespace std;
 
-enum DIRECTION {RIGHT = 0, FORWARD, LEFT, BACKWARD};
+enum DIRECTION {RIGHT = 0, FORWARD, LEFT, BACKWARD}; // same values as CTurnPlanner::heading
 enum WHEEL {FRONT_LEFT = 0, FRONT_RIGHT, BACK_LEFT, BACK_RIGHT};
-
-// {button, {channel, steps, dir}}
-// channel == 0 --> right fork
-// channel == 1 --> left fork
-map<Uint8, array<int, 3>> buttons;
-
+enum MOTOR_COMMAND {WHEELS_DRIVE = 0, WHEELS_OFF, WHEEL_TURN, FORKS_MOVE, FORKS_TO, FORKS_STOP};
+
+int level_height = 1300; // steps between pallet levels
+
+const string recording_path = "Recording.bin";
+const string legacy_recording_path = "Recording.txt"; // text format used before Recording.bin
+const string input_profile_path = "Controls.txt"; // rebinds buttons and axes, the built in profile is used without it
+const string capture_path = "Capture.bin"; // raw stick and trigger values, BACK starts and stops a capture
+const bool optimise_playback = true; // play recordings as a minimum-time plan from CPlanOptimiser
+
+// driving up to a pallet marker with the camera
+const string camera_source = "0"; // camera number, or a video file
+const double vision_roi[4] = {0, 0.25, 1, 0.75}; // part of the frame searched (x, y, width, height). Pallets sit low
+const double approach_stop_size = 0.25; // marker width as a fraction of the frame width where the forklift stops
+const double approach_speed = 0.6;      // forward motion when the marker is straight ahead
+const double approach_gain = 1.5;       // spin per unit of marker offset from the centre of the frame
+const int64_t approach_lost_ns = 500000000; // stop the wheels when no marker has been seen for this long
+const int vision_benchmark_s = 10; // length of a --vision run from a camera, files run to the end
+
+// turns stop when the camera has seen them through, and fall back to timed turns without one
+const bool closed_loop_turns = true;
+const double camera_fov_deg = 62.2;   // horizontal field of view
+const double turn_stop_lead_deg = 4;  // stop this far short, the wheels take a moment to spin down
+
+// commands from another process, see CRemote. Wheels the remote set moving stop if it goes quiet.
+// Only this machine can send them, Forklift --remote <address> listens elsewhere, udp:5005 on every interface
+const string remote_address = "udp:127.0.0.1:5005";
+const Uint32 remote_deadman_ms = 250;
+
+// state published to other processes every control tick, Monitor shows it
+const string telemetry_name = "/forklift-telemetry";
+
+const Uint32 control_tick_ms = 10; // period of the fixed-rate control tick
+const Uint32 idle_after_ms = 60000; // time without controller input before going idle
+const Uint32 idle_wait_ms = 1000;   // longest sleep while idle, for signals and stats
+
+// drive PWM, set once at startup. Duty cycles elsewhere are out of 255, turn_wheel takes the full range.
+// The back wheels use DMA PWM, which has 125 duty steps at 800 Hz with pigpio's 10 us clock. A higher
+// frequency leaves them fewer, 25 at 4 kHz, and all four wheels are held to the coarsest
+const int pwm_frequency = 800;
+const int pwm_range = 1000;
+
+// battery divider on the ADC, wheel duties are scaled up as the battery runs down
+const int battery_channel = 1;
+const double battery_divider = 4.0; // battery volts per volt at the ADC pin
+
+const string trace_path = "Trace.txt"; // latency histograms, written on exit or SIGUSR1 when built with FORKLIFT_TRACE
+
+// timing of the main loop, printed on exit
+struct loop_stats {
+    unsigned long ticks;
+    unsigned long late_ticks;    // ticks that ran a full period or more behind schedule
+    unsigned long axis_events;      // axis events received
+    unsigned long axis_applied;     // axis values applied after coalescing
+    unsigned long commands_skipped; // wheel commands dropped because nothing changed
+    unsigned long idle_entries;
+    unsigned long deadman_stops;    // remote went quiet while driving
+    double active_seconds, active_cpu; // wall and process CPU time spent active
+    double idle_seconds, idle_cpu;     // and idle
+} stats = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+
+// idle mode and when the current mode started, on the wall and process CPU clocks
+bool idle = false;
+timespec mode_wall, mode_cpu;
+
+// latest value of each controller axis, applied once per control tick
+struct axis_state {
+    Sint16 value;
+    Uint32 timestamp;
+    unsigned long seq; // order the axes last moved in
+    bool pending;
+} axes[SDL_CONTROLLER_AXIS_MAX];
+unsigned long axis_seq = 0;
+
+static_assert((int)SDL_CONTROLLER_AXIS_MAX <= (int)CAxisCapture::MAX_AXES, "every axis has to fit in a capture");
+
+// capture in progress, stored once per control tick
+CAxisCapture capture;
+Uint32 capture_start;
+vector<uint8_t> captured_buttons; // pressed since the last tick
+
+// capture being replayed, fed through the input path one control tick at a time
+vector<CAxisCapture::frame> replay_frames;
+size_t replay_next = 0;          // first frame not fed yet
+vector<uint8_t> replay_buttons;  // replayed buttons waiting for a routine to end
+Uint32 replay_start;
+uint32_t replay_period_us;
+bool replaying = false;
+
+// recording in progress, the sticks drive a direction at a time and each segment is timed
+bool recording = false;
+int record_dir = -1;  // direction of the segment being recorded, -1 when stopped
+int record_held = -1; // last direction the sticks asked for, driven once a recorded turn ends
+chrono::steady_clock::time_point record_start; // when that segment started
+
+// buttons pressed while a routine has the wheels, handled once it ends
+vector<pair<Uint8, Uint32>> deferred_buttons;
+
+// last command sent to each wheel and whether each driver is out of standby (front, back). Motor thread only
+int applied_duty[4] = {-1, -1, -1, -1};
+int applied_dir[4] = {-1, -1, -1, -1};
+bool standby_on[2] = {false, false};
+
+// signed duty of each wheel out of the PWM range, 0 in standby. Written by the motor thread for telemetry
+atomic<int> wheel_duty[4];
+
+// motion asked for by the axes, indexed by CInputMap::motion. -1 to 1
+double motion[CInputMap::MOTIONS] = {0, 0, 0, 0, 0};
+
+// run on the motor thread
+void run_command(const CMotorThread::command& c);
 void turn_wheel(int channel, int duty_cycle, int dir);
+int to_pwm(int duty_cycle);
+void drive(double vx, double vy, double omega, int duty_cycle);
+bool wheels_match(const int duty[4], const int dir[4]);
 void all_wheels_off();
-void handle_laterals(SDL_Event e);
-
-int move_forklift(Uint8 button, int &facing, int duty_cycle = 200);
-void record(int facing);
+void move_forks(const array<int, 3>& command);
+
+// run on the SDL thread
+void send(int type, int a = 0, int b = 0, int c = 0, Uint32 timestamp = 0);
+void send_drive(double vx, double vy, double omega, int duty_cycle = 200, Uint32 timestamp = 0);
+int64_t event_ns(Uint32 timestamp);
+void handle_laterals(Uint8 axis, Sint16 value, Uint32 timestamp = 0);
+void queue_axis(Uint8 axis, Sint16 value, Uint32 timestamp);
+void apply_axes();
+void control_tick(Uint32 late_ms);
+void handle_button(Uint8 button, Uint32 timestamp, int& facing);
+void run_button(Uint8 button, Uint32 timestamp, int& facing);
+void poll_routine(int& facing);
+void abort_routine();
+void toggle_approach();
+void approach_tick();
+void stop_approach();
+bool start_turn_camera();
+void start_turn(int duration, int degrees);
+void stop_turn_after(int64_t after_ns);
+void track_turn();
+int turn_test(int argc, char* argv[]);
+void turn_to(int heading, int& facing, Uint32 timestamp = 0);
+void handle_remote(int& facing);
+void remote_command(const CRemote::command& c, int& facing);
+int remote_benchmark(int argc, char* argv[]);
+int vision_benchmark(int argc, char* argv[]);
+bool forks_moving();
+void send_forks(const CInputMap::binding& b, Uint32 timestamp = 0);
+void toggle_capture();
+void capture_tick();
+void play_capture();
+void replay_tick(int& facing);
+void stop_replay(bool finished);
+bool is_input(const SDL_Event& e);
+void set_idle(bool now_idle);
+void account_time();
+void print_loop_stats();
+void publish_telemetry(int facing);
+
+int move_forklift(int heading, int &facing, int duty_cycle = 200, Uint32 timestamp = 0);
+void start_recording();
+void record_button(const CInputMap::binding& b, Uint32 timestamp, int& facing);
+void record_axis(Uint8 axis, Sint16 value);
+void record_drive(int dir);
+void record_turn(int heading, int& facing);
+void stop_recording(bool signal);
+void end_segment(int& last_dir, int next_dir, chrono::steady_clock::time_point& start);
 void play_back();
-
-CControl control;
+void play_action(const CPlayback::action& a);
+int simulate(int argc, char* argv[]);
+
+// the hardware, built by main once the forklift itself runs, so the offline modes never start the GPIO backend
+CControl* control = nullptr;
+CBatteryComp* battery = nullptr;
+CForkPlanner* forks = nullptr;
+CRecorder recorder;
+CMixer mixer;
+CInputMap input;
+CTurnPlanner turns;
+CMotorThread motors;
+CSequencer sequencer(play_action, forks_moving);
+CVision vision;
+bool approaching = false;
+int64_t marker_seen_ns = 0; // when the approach last saw a marker
+CTurnTracker tracker(camera_fov_deg);
+int turn_target = 0; // degrees the turn being tracked has to go, 0 when no turn is tracked
+int64_t turn_end_ns = 0; // when the turn being tracked is planned to end, its stop if tracking is lost
+int drive_dc = 0;    // duty cycle of the last drive command, 0 once the wheels are off
+CRemote remote;
+CTelemetry telemetry;
+Uint32 remote_event = (Uint32)-1; // SDL event the receiver wakes the input thread with
+Uint32 remote_seen = 0;           // when the last remote packet was handled
+bool remote_driving = false;      // the remote's last drive command moves the wheels
 
 int main(int argc, char* argv[]) {
+    // Forklift --convert <in> <out> converts a recording between the text and binary formats
+    if (argc == 4 && string(argv[1]) == "--convert") {
+        if (!CRecorder::convert(argv[2], argv[3])) {
+            cout << "Could not convert " << argv[2] << "\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    // Forklift --optimise <in> <out> writes a simplified recording and reports the projected cycle time
+    if (argc == 4 && string(argv[1]) == "--optimise") {
+        vector<CRecorder::record> records, simplified;
+        vector<CPlayback::action> actions;
+
+        if (!CRecorder::load(argv[2], records)) {
+            cout << "Could not read " << argv[2] << "\n";
+            return 1;
+        }
+
+        // fork move times come from the planner, which only needs a CControl on the simulator
+        CSimBackend sim;
+        CControl sim_control(sim);
+        CForkPlanner sim_forks(sim_control);
+
+        CPlanOptimiser optimiser(sim_forks);
+        optimiser.compile(records, actions);
+        optimiser.simplify(records, simplified);
+        optimiser.print_report();
+
+        string out = argv[3];
+        bool text = out.size() > 4 && out.compare(out.size() - 4, 4, ".txt") == 0;
+        if (!(text ? CRecorder::save_text(out, simplified) : CRecorder::save_binary(out, simplified))) {
+            cout << "Could not write " << out << "\n";
+            return 1;
+        }
+        return 0;
+    }
+
+    // Forklift --simulate <recording>... plays recordings on the kinematic model and prints where they end up
+    // Forklift --sweep <recording> <turn_90|turn_180|strafe_gain> <first> <last> <step> does it over a range of one setting
+    if (argc >= 3 && (string(argv[1]) == "--simulate" || string(argv[1]) == "--sweep")) return simulate(argc, argv);
+
+    // Forklift --vision <camera|video> [fast] runs the marker search alone and reports throughput and latency.
+    // A video is read at its own frame rate, or as fast as it decodes with fast
+    if (argc >= 3 && string(argv[1]) == "--vision") return vision_benchmark(argc, argv);
+
+    // Forklift --turn-test <video> <degrees> measures the turn in a video and compares it with the known rotation
+    if (argc == 4 && string(argv[1]) == "--turn-test") return turn_test(argc, argv);
+
+    // Forklift --remote-bench <address> [packets] measures the round trip to a running Forklift's remote endpoint
+    if (argc >= 3 && string(argv[1]) == "--remote-bench") return remote_benchmark(argc, argv);
+
+    // Forklift --remote <address> runs the forklift with remote control on another address
+    string remote_listen = remote_address;
+    if (argc == 3 && string(argv[1]) == "--remote") remote_listen = argv[2];
+
+    // from here on the forklift runs, so the pins, steppers and ADC start. The backend exits if it can't
+    CControl hardware;
+    CBatteryComp hardware_battery(hardware.get_adc(), battery_channel, battery_divider);
+    CForkPlanner hardware_forks(hardware);
+    control = &hardware;
+    battery = &hardware_battery;
+    forks = &hardware_forks;
+
     if (SDL_Init(SDL_INIT_GAMECONTROLLER) < 0) {
         cout << "Initialization Error: " << SDL_GetError() << "\n";\
         SDL_Quit();
@@ -49,71 +312,655 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    int level_steps = 200;
-    int fine_steps = 10;
-
-    buttons[SDL_CONTROLLER_BUTTON_RIGHTSHOULDER] = {0, level_steps, 1};
-    buttons[SDL_CONTROLLER_BUTTON_RIGHTSTICK] =    {0, level_steps, 0};
-    buttons[SDL_CONTROLLER_BUTTON_LEFTSTICK] =     {1, level_steps, 1};
-    buttons[SDL_CONTROLLER_BUTTON_LEFTSHOULDER] =  {1, level_steps, 0};
-    buttons[SDL_CONTROLLER_BUTTON_DPAD_UP] =       {1, fine_steps,  1};
-    buttons[SDL_CONTROLLER_BUTTON_DPAD_LEFT] =     {1, fine_steps,  0};
-    buttons[SDL_CONTROLLER_BUTTON_DPAD_RIGHT] =    {0, fine_steps,  0};
-    buttons[SDL_CONTROLLER_BUTTON_DPAD_DOWN] =     {0, fine_steps,  1};
+    if (input.load(input_profile_path)) cout << "Controls read from " << input_profile_path << "\n";
 
     SDL_Event e;
     bool quit = false;
 
     int facing = FORWARD; // facing forward by default
 
-    all_wheels_off();
+    if (!control->configure_pwm(pwm_frequency, pwm_range)) cout << "Could not configure the drive PWM\n";
+    cout << "Drive PWM: " << pwm_frequency << " Hz, " << control->get_pwm_steps() << " duty steps on every wheel\n";
+
+    // everything that moves a motor runs on the motor thread, this thread only handles input
+    motors.start(run_command);
+    send(WHEELS_OFF);
+
+    if (closed_loop_turns && !start_turn_camera()) cout << "Could not open camera " << camera_source << ", turns are timed\n";
+
+    // the receiver wakes this thread with an SDL event, so packets don't wait for the next tick
+    remote_event = SDL_RegisterEvents(1);
+    if (remote_event != (Uint32)-1 && remote.open(remote_listen, true)) {
+        remote.start([]() {
+            SDL_Event wake;
+            SDL_zero(wake);
+            wake.type = remote_event;
+            SDL_PushEvent(&wake);
+        });
+        cout << "Remote control on " << remote_listen << "\n";
+    } else {
+        cout << "Could not open " << remote_listen << ", remote control is off\n";
+    }
+
+    if (!telemetry.create(telemetry_name)) cout << "Could not create " << telemetry_name << ", no telemetry is published\n";
+
+    TRACE_INSTALL(SIGUSR1);
+
+    clock_gettime(CLOCK_MONOTONIC, &mode_wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &mode_cpu);
+
+    Uint32 next_tick = SDL_GetTicks() + control_tick_ms;
+    Uint32 last_input = SDL_GetTicks();
 
     while (!quit) {
-        while (SDL_PollEvent(&e)) {
-            if (e.type == SDL_CONTROLLERBUTTONDOWN) {
-                if (buttons.find(e.cbutton.button) != buttons.end()) {
-                    control.set_data(control.STEPPER, buttons[e.cbutton.button][0], buttons[e.cbutton.button][1] == 200 ? 1300 : 200, buttons[e.cbutton.button][2]);
+        // sleep until an event arrives or the next control tick is due. There are no ticks while idle
+        Sint32 wait = idle ? (Sint32)idle_wait_ms : (Sint32)(next_tick - SDL_GetTicks());
+        if (wait < 0) wait = 0;
+
+        // wake for the next action of a running routine too
+        wait = sequencer.next_due_ms(wait);
+
+        if (SDL_WaitEventTimeout(&e, wait)) {
+            do {
+                if (is_input(e) || e.type == remote_event) {
+                    last_input = SDL_GetTicks();
+
+                    if (idle) {
+                        // the event that wakes us is handled like any other
+                        set_idle(false);
+                        next_tick = SDL_GetTicks() + control_tick_ms;
+                    }
                 }
 
-                if (e.cbutton.button == SDL_CONTROLLER_BUTTON_START) {
-                    record(facing);
-                } else if (e.cbutton.button == SDL_CONTROLLER_BUTTON_GUIDE) {
-                    play_back();
-                } else {
-                    int duration = move_forklift(e.cbutton.button, facing);
+                if (e.type == SDL_CONTROLLERBUTTONDOWN) {
+                    // stick movement from before the press has to land first
+                    apply_axes();
+                    handle_button(e.cbutton.button, e.common.timestamp, facing);
+                } else if (e.type == SDL_JOYAXISMOTION) {
+                    // the replay has the sticks, a recording takes them a direction at a time
+                    if (recording) record_axis(e.caxis.axis, e.caxis.value);
+                    else if (!replaying) queue_axis(e.caxis.axis, e.caxis.value, e.common.timestamp);
+                } else if (e.type == remote_event) {
+                    handle_remote(facing);
+                }
 
-                    if (duration > 0) {
-                        SDL_Delay(duration);
-                        all_wheels_off();
-                    }
+                if (e.type == SDL_QUIT) {
+                    quit = true;
                 }
-            } else if (e.type == SDL_JOYAXISMOTION) {
-                handle_laterals(e);
-            }
+            } while (SDL_PollEvent(&e));
+        }
+
+        poll_routine(facing);
 
-            if (e.type == SDL_QUIT) {
-                quit = true;
-            }
+        if (idle) {
+            // once a wake, so readers can tell an idle forklift from a stopped one
+            publish_telemetry(facing);
+            TRACE_POLL(trace_path);
+            continue;
+        }
+
+        // don't go idle while the forks are still moving to their last target or a routine is running
+        if (SDL_GetTicks() - last_input >= idle_after_ms && !forks->busy() && !sequencer.busy() && !approaching && !replaying && !recording) {
+            set_idle(true);
+            continue;
+        }
+
+        Sint32 late = (Sint32)(SDL_GetTicks() - next_tick);
+        if (late >= 0) {
+            if (replaying) replay_tick(facing);
+            control_tick(late);
+            publish_telemetry(facing);
+            next_tick += control_tick_ms;
+
+            // a stall can leave us many ticks behind, don't run them back to back
+            if (late >= (Sint32)control_tick_ms) next_tick = SDL_GetTicks() + control_tick_ms;
         }
     }
 
-    all_wheels_off();
+    account_time();
+
+    sequencer.cancel();
+    stop_approach();
+    vision.stop();
+    remote.close();
+    send(WHEELS_OFF);
+    telemetry.close();
+    motors.stop();
+    forks->stop();
+    control->print_stats();
+    motors.print_stats();
+    tracker.print_stats();
+    battery->print_stats();
+    remote.print_stats();
+    TRACE_DUMP(trace_path);
+    print_loop_stats();
     SDL_GameControllerClose(controller);
     SDL_Quit();
 
     return 0;
 }
 
+void control_tick(Uint32 late_ms) {
+    stats.ticks++;
+    if (late_ms >= control_tick_ms) stats.late_ticks++;
+
+    battery->update(control_tick_ms / 1000.0);
+
+    if (remote_driving && SDL_GetTicks() - remote_seen > remote_deadman_ms) {
+        send(WHEELS_OFF);
+        remote_driving = false;
+        stats.deadman_stops++;
+        cout << "Remote went quiet, wheels stopped\n";
+    }
+
+    apply_axes();
+    if (approaching) approach_tick();
+    if (capture.is_open()) capture_tick();
+    TRACE_POLL(trace_path);
+}
+
+void handle_button(Uint8 button, Uint32 timestamp, int& facing) {
+    const CInputMap::binding& b = input.button(button);
+
+    // buttons that start and stop recordings are left out of captures
+    if (capture.is_open() && !input.is_mode_button(button)) captured_buttons.push_back(button);
+
+    if (sequencer.busy() || replaying) {
+        // a routine or a replay has the wheels. Abort stops it straight away, anything else waits for it to end
+        if (b.command == CInputMap::ABORT || b.command == CInputMap::PLAY_BACK) abort_routine();
+        else if (replaying && b.command == CInputMap::PLAY_CAPTURE) abort_routine();
+        else deferred_buttons.push_back(make_pair(button, timestamp));
+        return;
+    }
+
+    run_button(button, timestamp, facing);
+}
+
+void run_button(Uint8 button, Uint32 timestamp, int& facing) {
+    const CInputMap::binding& b = input.button(button);
+
+    if (recording && b.command != CInputMap::ABORT) {
+        record_button(b, timestamp, facing);
+        return;
+    }
+
+    if (b.command == CInputMap::FORKS_LEVEL || b.command == CInputMap::FORKS_STEP) {
+        // forks move in the background so the wheels keep responding
+        send_forks(b, timestamp);
+    } else if (b.command == CInputMap::TURN) {
+        turn_to(b.value, facing, timestamp);
+    } else if (b.command == CInputMap::RECORD) {
+        start_recording();
+    } else if (b.command == CInputMap::PLAY_BACK) {
+        play_back();
+    } else if (b.command == CInputMap::CAPTURE) {
+        toggle_capture();
+    } else if (b.command == CInputMap::PLAY_CAPTURE) {
+        play_capture();
+    } else if (b.command == CInputMap::ABORT) {
+        abort_routine();
+    } else if (b.command == CInputMap::APPROACH) {
+        toggle_approach();
+    }
+}
+
+void poll_routine(int& facing) {
+    if (turn_target > 0) track_turn();
+    sequencer.poll();
+
+    // buttons held back by the routine, in the order they were pressed. One of them may start another routine
+    size_t i = 0;
+    for (; i < deferred_buttons.size() && !sequencer.busy() && !replaying; i++) {
+        run_button(deferred_buttons[i].first, deferred_buttons[i].second, facing);
+    }
+    deferred_buttons.erase(deferred_buttons.begin(), deferred_buttons.begin() + i);
+}
+
+void abort_routine() {
+    // the wheels and forks stop where they are, whatever was running
+    sequencer.cancel();
+    stop_approach();
+    if (replaying) stop_replay(false);
+    if (recording) stop_recording(false);
+    deferred_buttons.clear();
+    send(WHEELS_OFF);
+    send(FORKS_STOP);
+    cout << "Aborted\n";
+}
+
+void toggle_approach() {
+    if (approaching) {
+        stop_approach();
+        send(WHEELS_OFF);
+        return;
+    }
+
+    // the camera goes over from following turns to searching for markers
+    vision.stop();
+    vision.set_roi(vision_roi[0], vision_roi[1], vision_roi[2], vision_roi[3]);
+    if (!vision.start(camera_source)) {
+        cout << "Could not open camera " << camera_source << "\n";
+        start_turn_camera();
+        return;
+    }
+
+    approaching = true;
+    marker_seen_ns = CMotorThread::now_ns();
+    cout << "Approach Started\n";
+}
+
+void approach_tick() {
+    // the newest search result, older ones are never looked at
+    const CVision::detection* d = vision.latest();
+
+    if (!vision.is_running()) {
+        stop_approach();
+        send(WHEELS_OFF);
+        return;
+    }
+
+    if (d == nullptr || d->markers.empty()) {
+        // stop and wait where we are for the marker to come back
+        if (marker_seen_ns != 0 && CMotorThread::now_ns() - marker_seen_ns > approach_lost_ns) {
+            send(WHEELS_OFF);
+            marker_seen_ns = 0;
+        }
+        return;
+    }
+
+    // the biggest marker is the nearest pallet
+    const CVision::marker* target = &d->markers[0];
+    for (size_t i = 1; i < d->markers.size(); i++) {
+        if (d->markers[i].size > target->size) target = &d->markers[i];
+    }
+    marker_seen_ns = d->captured_ns;
+
+    if (target->size >= approach_stop_size * d->width) {
+        stop_approach();
+        send(WHEELS_OFF);
+        cout << "Reached Pallet " << target->id << "\n";
+        return;
+    }
+
+    // turn towards the marker, and only drive on while it is roughly ahead
+    double offset = (target->x - d->width / 2.0) / (d->width / 2.0);
+    double forward = approach_speed * max(0.0, 1 - 2 * fabs(offset));
+    send_drive(forward, 0, approach_gain * offset);
+}
+
+void stop_approach() {
+    if (!approaching) return;
+
+    approaching = false;
+    vision.stop();
+    vision.print_stats();
+    start_turn_camera();
+    cout << "Approach Finished\n";
+}
+
+bool start_turn_camera() {
+    if (!closed_loop_turns || vision.is_running()) return vision.is_running();
+
+    // frames are left for track_turn, nothing searches them
+    return vision.start(camera_source, true, false);
+}
+
+void turn_to(int heading, int& facing, Uint32 timestamp) {
+    int quarters = CTurnPlanner::quarter_turns(facing, heading);
+    int duration = move_forklift(heading, facing, 200, timestamp);
+
+    if (duration > 0) start_turn(duration, abs(quarters) * 90);
+}
+
+void start_turn(int duration, int degrees) {
+    // the newest frame is from before the wheels started, it is the reference
+    const CVision::frame* f = nullptr;
+    if (closed_loop_turns && vision.is_running() && !vision.is_searching()) f = vision.latest_frame(false);
+
+    turn_target = f != nullptr ? degrees : 0;
+    if (f != nullptr) {
+        tracker.reset();
+        tracker.add(f->image);
+    }
+
+    // the turn stops from the routine, so input is still read while it runs. A tracked turn stops when
+    // track_turn sees it through, and gets half as long again before the backstop while tracking holds
+    int64_t stop_ns = duration * 1000000LL;
+    turn_end_ns = CMotorThread::now_ns() + stop_ns;
+    if (turn_target > 0) stop_ns += stop_ns / 2;
+
+    stop_turn_after(stop_ns);
+}
+
+void stop_turn_after(int64_t after_ns) {
+    CPlayback::action stop = {after_ns, CPlayback::STOP, -1, 0, -1, -1};
+    sequencer.start(vector<CPlayback::action>(1, stop), [](bool finished) {
+        if (finished && turn_target > 0) cout << "Turn not seen through, stopped at the backstop\n";
+        turn_target = 0;
+    });
+}
+
+void track_turn() {
+    const CVision::frame* f = vision.latest_frame();
+    if (f == nullptr) return;
+
+    // the reference went in with start_turn, so a frame that can't be measured means tracking is lost.
+    // The turn is timed from here on and stops when it was planned to, not at the backstop
+    if (!tracker.add(f->image)) {
+        sequencer.cancel();
+        stop_turn_after(max((int64_t)0, turn_end_ns - CMotorThread::now_ns()));
+        cout << "Lost track of the turn, stopping on time\n";
+        return;
+    }
+
+    if (fabs(tracker.get_yaw()) >= turn_target - turn_stop_lead_deg) {
+        turn_target = 0;
+        sequencer.cancel();
+        send(WHEELS_OFF);
+    }
+}
+
+void handle_remote(int& facing) {
+    CRemote::packet p;
+
+    while (remote.receive(p)) {
+        remote_seen = SDL_GetTicks();
+
+        for (int i = 0; i < p.count; i++) remote_command(p.commands[i], facing);
+
+        // answered once the commands are with the motor thread, so the round trip covers this thread too
+        if (p.h.flags & CRemote::ACK) remote.reply(p);
+    }
+}
+
+void remote_command(const CRemote::command& c, int& facing) {
+    // a routine, an approach, a replay or a recording has the wheels, the remote can only stop it
+    bool wheels_free = !sequencer.busy() && !approaching && !replaying && !recording;
+
+    if (c.type == CRemote::DRIVE && wheels_free) {
+        send_drive(c.value[0] / 1000.0, c.value[1] / 1000.0, c.value[2] / 1000.0);
+        remote_driving = c.value[0] != 0 || c.value[1] != 0 || c.value[2] != 0;
+    } else if (c.type == CRemote::STOP && wheels_free) {
+        send(WHEELS_OFF);
+        remote_driving = false;
+    } else if (c.type == CRemote::FORKS_MOVE) {
+        // FORKS_MOVE takes {fork, levels, fine steps}, the same as the buttons
+        send(FORKS_MOVE, c.channel, c.value[0], c.value[1]);
+    } else if (c.type == CRemote::FORKS_TO) {
+        send(FORKS_TO, c.channel, c.value[0]);
+    } else if (c.type == CRemote::FORKS_STOP) {
+        send(FORKS_STOP);
+    } else if (c.type == CRemote::TURN && wheels_free) {
+        remote_driving = false;
+        turn_to(c.value[0], facing);
+    } else if (c.type == CRemote::ABORT) {
+        remote_driving = false;
+        abort_routine();
+    }
+}
+
+bool forks_moving() {
+    // fork commands sent before this have to reach the planner first
+    motors.sync();
+    return forks->busy();
+}
+
+void send_forks(const CInputMap::binding& b, Uint32 timestamp) {
+    // FORKS_MOVE takes {fork, levels, fine steps}
+    if (b.command == CInputMap::FORKS_LEVEL) send(FORKS_MOVE, b.channel, b.value, 0, timestamp);
+    else send(FORKS_MOVE, b.channel, 0, b.value, timestamp);
+}
+
+void toggle_capture() {
+    if (capture.is_open()) {
+        Uint32 ticks = (SDL_GetTicks() - capture_start) / control_tick_ms;
+        unsigned long frames = capture.frames();
+        size_t bytes = capture.bytes();
+
+        if (!capture.close()) {
+            cout << "Could not write " << capture_path << "\n";
+            return;
+        }
+
+        cout << "Capture Finished: " << ticks << " ticks, " << frames << " frames in " << bytes << " bytes ("
+             << (size_t)ticks * SDL_CONTROLLER_AXIS_MAX * sizeof(Sint16) << " bytes raw)\n";
+        return;
+    }
+
+    // the sticks and triggers as they are now become the first frame
+    int16_t values[SDL_CONTROLLER_AXIS_MAX];
+    for (int i = 0; i < SDL_CONTROLLER_AXIS_MAX; i++) values[i] = axes[i].value;
+
+    capture.open(capture_path, SDL_CONTROLLER_AXIS_MAX, control_tick_ms * 1000, values);
+    capture_start = SDL_GetTicks();
+    captured_buttons.clear();
+    cout << "Capture Started\n";
+}
+
+void capture_tick() {
+    // values as handle_laterals last saw them, so a capture holds exactly what drove the wheels
+    int16_t values[SDL_CONTROLLER_AXIS_MAX];
+    for (int i = 0; i < SDL_CONTROLLER_AXIS_MAX; i++) values[i] = axes[i].value;
+
+    capture.add((SDL_GetTicks() - capture_start) / control_tick_ms, values, captured_buttons);
+    captured_buttons.clear();
+}
+
+void play_capture() {
+    if (capture.is_open() || !CAxisCapture::load(capture_path, replay_frames, replay_period_us)) {
+        cout << "No capture to replay\n";
+        return;
+    }
+
+    // replay_tick feeds the frames from the control tick, so input and the deadman keep running
+    replay_next = 0;
+    replay_buttons.clear();
+    replay_start = SDL_GetTicks();
+    replaying = true;
+    cout << "Replaying Capture\n";
+}
+
+void replay_tick(int& facing) {
+    Uint32 now = SDL_GetTicks();
+    uint64_t tick = (uint64_t)(now - replay_start) * 1000 / replay_period_us;
+
+    // every frame that is due, the values go through the same path as live input
+    for (; replay_next < replay_frames.size() && replay_frames[replay_next].tick <= tick; replay_next++) {
+        const CAxisCapture::frame& f = replay_frames[replay_next];
+
+        for (int a = 0; a < SDL_CONTROLLER_AXIS_MAX; a++) {
+            if (f.changed & (1 << a)) queue_axis(a, f.values[a], now);
+        }
+        apply_axes();
+
+        replay_buttons.insert(replay_buttons.end(), f.buttons.begin(), f.buttons.end());
+    }
+
+    // a replayed button waits for a routine it is pressed during, as it did when it was captured
+    size_t i = 0;
+    while (i < replay_buttons.size() && !sequencer.busy()) {
+        run_button(replay_buttons[i++], now, facing);
+        if (!replaying) return;
+    }
+    replay_buttons.erase(replay_buttons.begin(), replay_buttons.begin() + i);
+
+    if (replay_next == replay_frames.size() && replay_buttons.empty()) stop_replay(true);
+}
+
+void stop_replay(bool finished) {
+    replaying = false;
+    replay_frames.clear();
+    replay_buttons.clear();
+
+    // the real sticks take over again from their next event
+    for (int i = 0; i < CInputMap::MOTIONS; i++) motion[i] = 0;
+    send(WHEELS_OFF);
+    cout << (finished ? "Replay Finished\n" : "Replay Stopped\n");
+}
+
+bool is_input(const SDL_Event& e) {
+    // joystick and game controller events
+    return e.type >= SDL_JOYAXISMOTION && e.type < SDL_FINGERDOWN;
+}
+
+void set_idle(bool now_idle) {
+    if (now_idle == idle) return;
+
+    account_time();
+    idle = now_idle;
+
+    if (idle) {
+        // drivers in standby draw no current, the next wheel command takes them out again
+        send(WHEELS_OFF);
+        vision.stop();
+        stats.idle_entries++;
+        cout << "Idle\n";
+    } else {
+        start_turn_camera();
+    }
+
+    control->set_idle(idle);
+}
+
+void account_time() {
+    timespec wall, cpu;
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+
+    double seconds = (wall.tv_sec - mode_wall.tv_sec) + (wall.tv_nsec - mode_wall.tv_nsec) / 1e9;
+    double cpu_seconds = (cpu.tv_sec - mode_cpu.tv_sec) + (cpu.tv_nsec - mode_cpu.tv_nsec) / 1e9;
+
+    if (idle) {
+        stats.idle_seconds += seconds;
+        stats.idle_cpu += cpu_seconds;
+    } else {
+        stats.active_seconds += seconds;
+        stats.active_cpu += cpu_seconds;
+    }
+
+    mode_wall = wall;
+    mode_cpu = cpu;
+}
+
+void print_loop_stats() {
+    // process CPU time includes the pigpio, stepper, motor and ADC threads
+    cout << "Control ticks: " << stats.ticks << " (" << stats.late_ticks << " late)\n";
+    cout << "Active: " << stats.active_seconds << " s, CPU use "
+         << (stats.active_seconds > 0 ? 100 * stats.active_cpu / stats.active_seconds : 0) << "% of one core\n";
+    cout << "Idle: " << stats.idle_seconds << " s over " << stats.idle_entries << " periods, CPU use "
+         << (stats.idle_seconds > 0 ? 100 * stats.idle_cpu / stats.idle_seconds : 0) << "% of one core\n";
+
+    if (stats.deadman_stops > 0) cout << "Remote deadman stops: " << stats.deadman_stops << "\n";
+
+    cout << "Axis events: " << stats.axis_events << ", applied: " << stats.axis_applied
+         << ", wheel commands skipped: " << stats.commands_skipped << "\n";
+}
+
+void publish_telemetry(int facing) {
+    CTelemetry::state s;
+    uint32_t flags = 0;
+
+    s.tick = stats.ticks;
+    s.time_ns = CMotorThread::now_ns();
+    s.facing = facing;
+    s.dc = drive_dc;
+    for (int i = 0; i < 4; i++) s.wheel_duty[i] = wheel_duty[i].load(memory_order_relaxed);
+    s.pwm_range = control->get_pwm_range();
+
+    // all of these are safe to read while the motor, stepper and ADC threads run
+    for (int i = 0; i < 2; i++) {
+        s.fork_position[i] = control->stepper_position(i);
+        s.adc[i] = (float)control->get_adc().value(i);
+    }
+    s.battery_volts = (float)battery->get_volts();
+    s.battery_gain = (float)battery->get_gain();
+    s.late_ticks = stats.late_ticks;
+
+    if (idle) flags |= CTelemetry::IDLE;
+    if (sequencer.busy() || replaying) flags |= CTelemetry::ROUTINE;
+    if (approaching) flags |= CTelemetry::APPROACH;
+    if (capture.is_open()) flags |= CTelemetry::CAPTURE;
+    if (recording) flags |= CTelemetry::RECORDING;
+    if (forks->busy()) flags |= CTelemetry::FORKS_BUSY;
+    if (remote_driving) flags |= CTelemetry::REMOTE;
+    s.flags = flags;
+
+    telemetry.publish(s);
+}
+
+void run_command(const CMotorThread::command& c) {
+    TRACE_RESUME(c.event_ns, c.sent_ns);
+
+    if (c.type == WHEELS_DRIVE) {
+        drive(c.motion[0], c.motion[1], c.motion[2], c.args[0]);
+    } else if (c.type == WHEELS_OFF) {
+        all_wheels_off();
+    } else if (c.type == WHEEL_TURN) {
+        turn_wheel(c.args[0], to_pwm(c.args[1]), c.args[2]);
+    } else if (c.type == FORKS_MOVE) {
+        array<int, 3> command = {c.args[0], c.args[1], c.args[2]};
+        move_forks(command);
+    } else if (c.type == FORKS_TO) {
+        forks->move_to(c.args[0], c.args[1]);
+    } else if (c.type == FORKS_STOP) {
+        forks->stop();
+    }
+
+    TRACE_FINISH();
+}
+
+void send(int type, int a, int b, int c, Uint32 timestamp) {
+    if (type == WHEELS_OFF) {
+        drive_dc = 0;
+        remote_driving = false;
+    }
+
+    CMotorThread::command command = {type, {a, b, c}, {0, 0, 0}, event_ns(timestamp), 0};
+
+    TRACE_EVENT(command.event_ns);
+    TRACE_DISPATCH();
+
+    // stops wait for room rather than being dropped
+    bool stop = type == WHEELS_OFF || type == FORKS_STOP;
+    if (!motors.send(command, stop)) cout << "Motor queue full, command " << type << " dropped\n";
+}
+
+void send_drive(double vx, double vy, double omega, int duty_cycle, Uint32 timestamp) {
+    drive_dc = duty_cycle;
+
+    // whoever drives now has the wheels, remote_command sets this again for its own drives
+    remote_driving = false;
+
+    CMotorThread::command command = {WHEELS_DRIVE, {duty_cycle, 0, 0}, {vx, vy, omega}, event_ns(timestamp), 0};
+
+    TRACE_EVENT(command.event_ns);
+    TRACE_DISPATCH();
+    if (!motors.send(command)) cout << "Motor queue full, drive dropped\n";
+}
+
+int64_t event_ns(Uint32 timestamp) {
+    if (timestamp == 0) return 0;
+
+    // SDL timestamps are in ms on their own clock, count back from now to put them on the motor thread's clock
+    return CMotorThread::now_ns() - (int64_t)(SDL_GetTicks() - timestamp) * 1000000LL;
+}
+
 void all_wheels_off() {
-    control.set_data(control.DIGITAL, STANDBYF, 0);
-    control.set_data(control.DIGITAL, STANDBYB, 0);
+    control->begin_update();
+    control->set_data(control->DIGITAL, STANDBYF, 0);
+    control->set_data(control->DIGITAL, STANDBYB, 0);
+    control->commit_update();
+
+    standby_on[0] = false;
+    standby_on[1] = false;
+    for (int i = 0; i < 4; i++) wheel_duty[i].store(0, memory_order_relaxed);
 }
 
 void turn_wheel(int channel, int duty_cycle, int dir) {
     int standby, in1, in2, in1dir, in2dir;
 
-    // PWM, channel (0 -> A, 1 -> B), duty cycle, frequency
-    control.set_data(control.PWM, channel, abs(duty_cycle), 100);
+    // PWM, channel (0 -> A front, 1 -> B front, 2 -> A back, 3 -> B back), duty cycle out of the PWM range
+    control->set_data(control->PWM, channel, abs(duty_cycle));
 
     if (channel == FRONT_LEFT) {
         standby = STANDBYF;
@@ -141,389 +988,456 @@ void turn_wheel(int channel, int duty_cycle, int dir) {
         in2dir = 1;
     } else return;
 
-    control.set_data(control.DIGITAL, standby, 1);
-    control.set_data(control.DIGITAL, in1, in1dir);
-    control.set_data(control.DIGITAL, in2, in2dir);
-}
-
-int move_forklift(Uint8 button, int &facing, int duty_cycle) {
-    int turn_90_duration = 950;
-    int turn_180_duration = 1875;
-    int duration = 0;
-
-    // buttons to control turning
-    if (button == SDL_CONTROLLER_BUTTON_B) {
-        switch (facing) {
-            case RIGHT:
-                // don't turn
-                duration = 0;
-                break;
-            case FORWARD:
-                // right 90deg
-                turn_wheel(FRONT_RIGHT, duty_cycle, BACKWARD);
-                turn_wheel(BACK_RIGHT, duty_cycle, BACKWARD);
-                turn_wheel(FRONT_LEFT, duty_cycle, FORWARD);
-                turn_wheel(BACK_LEFT, duty_cycle, FORWARD);
-
-                duration = turn_90_duration;
-                break;
-            case LEFT:
-                // left 180deg
-                turn_wheel(FRONT_RIGHT, duty_cycle, FORWARD);
-                turn_wheel(BACK_RIGHT, duty_cycle, FORWARD);
-                turn_wheel(FRONT_LEFT, duty_cycle, BACKWARD);
-                turn_wheel(BACK_LEFT, duty_cycle, BACKWARD);
-
-                duration = turn_180_duration;
-                break;
-            case BACKWARD:
-                // left 90deg
-                turn_wheel(FRONT_RIGHT, duty_cycle, FORWARD);
-                turn_wheel(BACK_RIGHT, duty_cycle, FORWARD);
-                turn_wheel(FRONT_LEFT, duty_cycle, BACKWARD);
-                turn_wheel(BACK_LEFT, duty_cycle, BACKWARD);
-
-                duration = turn_90_duration;
-                break;
-            default: break;
-        }
-        facing = RIGHT;
-    } else if (button == SDL_CONTROLLER_BUTTON_Y) {
-        switch (facing) {
-            case RIGHT:
-                // left 90deg
-                turn_wheel(FRONT_RIGHT, duty_cycle, FORWARD);
-                turn_wheel(BACK_RIGHT, duty_cycle, FORWARD);
-                turn_wheel(FRONT_LEFT, duty_cycle, BACKWARD);
-                turn_wheel(BACK_LEFT, duty_cycle, BACKWARD);
-
-                duration = turn_90_duration;
-                break;
-            case FORWARD:
-                // don't turn
-                duration = 0;
-                break;
-            case LEFT:
-                // right 90deg
-                turn_wheel(FRONT_RIGHT, duty_cycle, BACKWARD);
-                turn_wheel(BACK_RIGHT, duty_cycle, BACKWARD);
-                turn_wheel(FRONT_LEFT, duty_cycle, FORWARD);
-                turn_wheel(BACK_LEFT, duty_cycle, FORWARD);
-
-                duration = turn_90_duration;
-                break;
-            case BACKWARD:
-                // left 180deg
-                turn_wheel(FRONT_RIGHT, duty_cycle, FORWARD);
-                turn_wheel(BACK_RIGHT, duty_cycle, FORWARD);
-                turn_wheel(FRONT_LEFT, duty_cycle, BACKWARD);
-                turn_wheel(BACK_LEFT, duty_cycle, BACKWARD);
-
-                duration = turn_180_duration;
-            default: break;
-        }
-        facing = FORWARD;
-    }  else if (button == SDL_CONTROLLER_BUTTON_X) {
-        switch (facing) {
-            case RIGHT:
-                // right 180deg
-                turn_wheel(FRONT_RIGHT, duty_cycle, BACKWARD);
-                turn_wheel(BACK_RIGHT, duty_cycle, BACKWARD);
-                turn_wheel(FRONT_LEFT, duty_cycle, FORWARD);
-                turn_wheel(BACK_LEFT, duty_cycle, FORWARD);
-
-                duration = turn_180_duration;
-                break;
-            case FORWARD:
-                // left 90deg
-                turn_wheel(FRONT_RIGHT, duty_cycle, FORWARD);
-                turn_wheel(BACK_RIGHT, duty_cycle, FORWARD);
-                turn_wheel(FRONT_LEFT, duty_cycle, BACKWARD);
-                turn_wheel(BACK_LEFT, duty_cycle, BACKWARD);
-
-                duration = turn_90_duration;
-                break;
-            case LEFT:
-                // don't turn
-                duration = 0;
-                break;
-            case BACKWARD:
-                // right 90deg
-                turn_wheel(FRONT_RIGHT, duty_cycle, BACKWARD);
-                turn_wheel(BACK_RIGHT, duty_cycle, BACKWARD);
-                turn_wheel(FRONT_LEFT, duty_cycle, FORWARD);
-                turn_wheel(BACK_LEFT, duty_cycle, FORWARD);
-
-                duration = turn_90_duration;
-            default: break;
-        }
-        facing = LEFT;
-    }  else if (button == SDL_CONTROLLER_BUTTON_A) {
-        switch (facing) {
-            case RIGHT:
-                // right 90deg
-                turn_wheel(FRONT_RIGHT, duty_cycle, BACKWARD);
-                turn_wheel(BACK_RIGHT, duty_cycle, BACKWARD);
-                turn_wheel(FRONT_LEFT, duty_cycle, FORWARD);
-                turn_wheel(BACK_LEFT, duty_cycle, FORWARD);
-
-                duration = turn_90_duration;
-                break;
-            case FORWARD:
-                // right 180deg
-                turn_wheel(FRONT_RIGHT, duty_cycle, BACKWARD);
-                turn_wheel(BACK_RIGHT, duty_cycle, BACKWARD);
-                turn_wheel(FRONT_LEFT, duty_cycle, FORWARD);
-                turn_wheel(BACK_LEFT, duty_cycle, FORWARD);
-
-                duration = turn_180_duration;
-                break;
-            case LEFT:
-                // left 90deg
-                turn_wheel(FRONT_RIGHT, duty_cycle, FORWARD);
-                turn_wheel(BACK_RIGHT, duty_cycle, FORWARD);
-                turn_wheel(FRONT_LEFT, duty_cycle, BACKWARD);
-                turn_wheel(BACK_LEFT, duty_cycle, BACKWARD);
-
-                duration = turn_90_duration;
-                break;
-            case BACKWARD:
-                // don't turn
-                duration = 0;
-                break;
-            default: break;
-        }
-        facing = BACKWARD;
+    // standby and both inputs change together, callers can group several wheels the same way
+    control->begin_update();
+    control->set_data(control->DIGITAL, standby, 1);
+    control->set_data(control->DIGITAL, in1, in1dir);
+    control->set_data(control->DIGITAL, in2, in2dir);
+    control->commit_update();
+
+    applied_duty[channel] = abs(duty_cycle);
+    applied_dir[channel] = dir;
+    standby_on[channel < BACK_LEFT ? 0 : 1] = true;
+    wheel_duty[channel].store(dir == BACKWARD ? -abs(duty_cycle) : abs(duty_cycle), memory_order_relaxed);
+}
+
+void move_forks(const array<int, 3>& command) {
+    int fork = command[0];
+
+    if (command[1] == 0) {
+        forks->move_by(fork, command[2]);
+        return;
     }
 
+    // levels count from where the forks are headed, both forks use their average
+    double current;
+    if (fork == CForkPlanner::BOTH_FORKS) current = (forks->target(CForkPlanner::RIGHT_FORK) + forks->target(CForkPlanner::LEFT_FORK)) / 2.0;
+    else current = forks->target(fork);
+
+    int level;
+    if (command[1] > 0) level = (int)floor(current / level_height) + command[1];
+    else level = (int)ceil(current / level_height) + command[1];
+
+    forks->move_to(fork, max(level, 0) * level_height);
+}
+
+int move_forklift(int heading, int &facing, int duty_cycle, Uint32 timestamp) {
+    // plan gives 0 for a heading that isn't one, and facing has to stay a real heading
+    if (heading < CTurnPlanner::RIGHT || heading > CTurnPlanner::BACKWARD) return 0;
+
+    double omega;
+    int duration = turns.plan(facing, heading, omega);
+    facing = heading;
+
+    if (duration == 0) return 0;
+
+    send_drive(0, 0, omega, duty_cycle, timestamp);
     return duration;
 }
 
-int dc = 0;
-void handle_laterals(SDL_Event e) {
-    if (e.caxis.axis == SDL_CONTROLLER_AXIS_LEFTX) {
-        // map the value to -200->200 for the joystick
-        dc = (int)((400.0 / 65535.0) * (e.caxis.value + 32768) - 200);
-        if (dc > 0 && dc < 140) dc = 0;
-        if (dc < 0 && dc > -140) dc = 0;
-
-        if (dc >= 0) {
-            turn_wheel(FRONT_RIGHT, dc, BACKWARD);
-            turn_wheel(FRONT_LEFT, dc, FORWARD);
-            turn_wheel(BACK_RIGHT, dc, FORWARD);
-            turn_wheel(BACK_LEFT, dc != 0 ? abs(dc) - 40 : dc, BACKWARD);
-        } else {
-            turn_wheel(FRONT_RIGHT, dc, FORWARD);
-            turn_wheel(FRONT_LEFT, dc, BACKWARD);
-            turn_wheel(BACK_RIGHT, dc, BACKWARD);
-            turn_wheel(BACK_LEFT, dc != 0 ? abs(dc) - 40 : dc, FORWARD);
-        }
-    } else if (e.caxis.axis == SDL_CONTROLLER_AXIS_TRIGGERRIGHT) {
-        double start = getTickCount();
-        // map the value to 0->200 for the right trigger
-        dc = (int)((200.0 / 65535.0) * (e.caxis.value + 32768));
-        if (dc > 0 && dc < 50) dc = 0;
-        if (dc < 0) dc = 0;
-
-        turn_wheel(FRONT_RIGHT, dc, FORWARD);
-        turn_wheel(FRONT_LEFT, dc, FORWARD);
-        turn_wheel(BACK_RIGHT, dc, FORWARD);
-        turn_wheel(BACK_LEFT, dc, FORWARD);
-    } else if (e.caxis.axis == SDL_CONTROLLER_AXIS_TRIGGERLEFT) {
-        // map the value to 0->200 for the left trigger
-        dc = (int)((200.0 / 65535.0) * (e.caxis.value + 32768));
-        if (dc > 0 && dc < 50) dc = 0;
-        if (dc < 0) dc = 0;
-
-        turn_wheel(FRONT_RIGHT, dc, BACKWARD);
-        turn_wheel(FRONT_LEFT, dc, BACKWARD);
-        turn_wheel(BACK_RIGHT, dc, BACKWARD);
-        turn_wheel(BACK_LEFT, dc, BACKWARD);
-    }
-}
-
-void record(int facing) {
-    bool finish_recording = false;
-    ofstream outfile;
-    SDL_Event e;
+void handle_laterals(Uint8 axis, Sint16 value, Uint32 timestamp) {
+    int m = input.axis(axis).motion;
+    if (m == CInputMap::NO_MOTION) return;
 
-    outfile.open("Recording.txt");
-    cout << "Recording Started\n";
+    motion[m] = input.scale(axis, value);
 
-    double start = getTickCount();
-    int last_dir = -1;
+    // every control adds to the motion, so a trigger and the stick together drive diagonally
+    send_drive(motion[CInputMap::DRIVE_FORWARD] - motion[CInputMap::DRIVE_BACKWARD], motion[CInputMap::STRAFE],
+               motion[CInputMap::SPIN], 200, timestamp);
+}
 
-    while (!finish_recording) {
-        while (SDL_PollEvent(&e)) {
-            if (e.type == SDL_CONTROLLERBUTTONDOWN) {
-                if (buttons.find(e.cbutton.button) != buttons.end()) {
-                    if (last_dir != -1) outfile << "DC -1 200 " + to_string(last_dir) + " " + to_string((getTickCount() - start) / getTickFrequency()) + " -1\n";
-                    start = getTickCount();
-                    last_dir = -1;
+void drive(double vx, double vy, double omega, int duty_cycle) {
+    int duty[4], dir[4];
 
-                    outfile << "STEPPER " << buttons[e.cbutton.button][0] << " " << buttons[e.cbutton.button][1] << " " << buttons[e.cbutton.button][2] << " -1 -1\n";
-                    control.set_data(control.STEPPER, buttons[e.cbutton.button][0], buttons[e.cbutton.button][1], buttons[e.cbutton.button][2]);
-                }
+    // the mixer works in the full PWM range so stick positions between the old 1/255 steps still count
+    mixer.mix(vx, vy, omega, to_pwm(duty_cycle), duty);
 
-                int prev_facing = facing;
+    for (int i = 0; i < 4; i++) {
+        dir[i] = duty[i] < 0 ? BACKWARD : FORWARD;
+        duty[i] = abs(duty[i]);
+    }
 
-                int duration = move_forklift(e.cbutton.button, facing);
+    // a stick resting near a threshold keeps producing the same command, don't send it again
+    if (wheels_match(duty, dir)) {
+        stats.commands_skipped++;
+        return;
+    }
 
-                if (duration > 0) {
-                    SDL_Delay(duration);
-                    all_wheels_off();
+    control->begin_update();
+    for (int i = 0; i < 4; i++) turn_wheel(i, duty[i], dir[i]);
+    control->commit_update();
+}
 
-                    if (last_dir != -1) outfile << "DC -1 200 " + to_string(last_dir) + " " + to_string((getTickCount() - start) / getTickFrequency()) + " -1\n";
-                    start = getTickCount();
-                    last_dir = -1;
+int to_pwm(int duty_cycle) {
+    // every wheel duty passes through here, so this is where the battery correction goes on
+    int range = control->get_pwm_range();
+    return battery->apply((int)((long long)duty_cycle * range / 255), range);
+}
 
-                    outfile << "DC -1 200 " << facing << " " << duration << " " << prev_facing << "\n";
-                }
+bool wheels_match(const int duty[4], const int dir[4]) {
+    for (int i = 0; i < 4; i++) {
+        if (!standby_on[i < BACK_LEFT ? 0 : 1]) return false;
+        if (applied_duty[i] != abs(duty[i]) || applied_dir[i] != dir[i]) return false;
+    }
 
-                if (e.cbutton.button == SDL_CONTROLLER_BUTTON_BACK) finish_recording = true;
-            } else if (e.type == SDL_JOYAXISMOTION) {
-                if (e.caxis.axis == SDL_CONTROLLER_AXIS_LEFTX) {
-                    if (e.caxis.value > 16384) {
-                        turn_wheel(FRONT_RIGHT, 200, BACKWARD);
-                        turn_wheel(FRONT_LEFT, 200, FORWARD);
-                        turn_wheel(BACK_RIGHT, 200, FORWARD);
-                        turn_wheel(BACK_LEFT, 160, BACKWARD);
-
-                        if (last_dir != RIGHT) {
-                            if (last_dir != -1) outfile << "DC -1 200 " + to_string(last_dir) + " " + to_string((getTickCount() - start) / getTickFrequency()) + " -1\n";
-                            start = getTickCount();
-                            last_dir = RIGHT;
-                        }
-                    } else if (e.caxis.value < -16384) {
-                        turn_wheel(FRONT_RIGHT, 200, FORWARD);
-                        turn_wheel(FRONT_LEFT, 200, BACKWARD);
-                        turn_wheel(BACK_RIGHT, 200, BACKWARD);
-                        turn_wheel(BACK_LEFT, 160, FORWARD);
-
-                        if (last_dir != LEFT) {
-                            if (last_dir != -1) outfile << "DC -1 200 " + to_string(last_dir) + " "  + to_string((getTickCount() - start) / getTickFrequency()) + " -1\n";
-                            start = getTickCount();
-                            last_dir = LEFT;
-                        }
-                    } else {
-                        if (last_dir != -1) outfile << "DC -1 200 " + to_string(last_dir) + " "  + to_string((getTickCount() - start) / getTickFrequency()) + " -1\n";
-                        start = getTickCount();
-                        last_dir = -1;
-                        all_wheels_off();
-                    }
-                } else if (e.caxis.axis == SDL_CONTROLLER_AXIS_TRIGGERRIGHT) {
-                    if (e.caxis.value > 0) {
-                        turn_wheel(FRONT_RIGHT, 200, FORWARD);
-                        turn_wheel(FRONT_LEFT, 200, FORWARD);
-                        turn_wheel(BACK_RIGHT, 200, FORWARD);
-                        turn_wheel(BACK_LEFT, 200, FORWARD);
-
-                        if (last_dir != FORWARD) {
-                            if (last_dir != -1) outfile << "DC -1 200 " + to_string(last_dir) + " "  + to_string((getTickCount() - start) / getTickFrequency()) + " -1\n";
-                            start = getTickCount();
-                            last_dir = FORWARD;
-                        }
-                    } else {
-                        if (last_dir != -1) outfile << "DC -1 200 " + to_string(last_dir) + " "  + to_string((getTickCount() - start) / getTickFrequency()) + " -1\n";
-                        start = getTickCount();
-                        last_dir = -1;
-                        all_wheels_off();
-                    }
-                } else if (e.caxis.axis == SDL_CONTROLLER_AXIS_TRIGGERLEFT) {
-                    if (e.caxis.value > 0) {
-                        turn_wheel(FRONT_RIGHT, 200, BACKWARD);
-                        turn_wheel(FRONT_LEFT, 200, BACKWARD);
-                        turn_wheel(BACK_RIGHT, 200, BACKWARD);
-                        turn_wheel(BACK_LEFT, 200, BACKWARD);
-
-                        if (last_dir != BACKWARD) {
-                            if (last_dir != -1) outfile << "DC -1 200 " + to_string(last_dir) + " "  + to_string((getTickCount() - start) / getTickFrequency()) + " -1\n";
-                            start = getTickCount();
-                            last_dir = BACKWARD;
-                        }
-                    } else {
-                        if (last_dir != -1) outfile << "DC -1 200 " + to_string(last_dir) + " "  + to_string((getTickCount() - start) / getTickFrequency()) + " -1\n";
-                        start = getTickCount();
-                        last_dir = -1;
-                        all_wheels_off();
-                    }
-                }
-            }
+    return true;
+}
+
+void queue_axis(Uint8 axis, Sint16 value, Uint32 timestamp) {
+    if (axis >= SDL_CONTROLLER_AXIS_MAX) return;
+
+    stats.axis_events++;
+    axes[axis].value = value;
+    axes[axis].timestamp = timestamp;
+    axes[axis].seq = ++axis_seq;
+    axes[axis].pending = true;
+}
+
+void apply_axes() {
+    // a routine or an approach has the wheels, the latest values land once it ends
+    if (sequencer.busy() || approaching) return;
+
+    // replay the latest value of each axis in the order the axes last moved
+    while (true) {
+        int next = -1;
+
+        for (int i = 0; i < SDL_CONTROLLER_AXIS_MAX; i++) {
+            if (axes[i].pending && (next == -1 || axes[i].seq < axes[next].seq)) next = i;
         }
+
+        if (next == -1) break;
+
+        axes[next].pending = false;
+        stats.axis_applied++;
+        handle_laterals(next, axes[next].value, axes[next].timestamp);
     }
+}
 
-    if (last_dir != -1) outfile << "DC -1 200 " + to_string(last_dir) + " "  + to_string((getTickCount() - start) / getTickFrequency()) + " -1";
+void start_recording() {
+    if (!recorder.open(recording_path)) {
+        cout << "Could not create " << recording_path << "\n";
+        return;
+    }
 
-    // turn front right wheel slightly to signify end of recording
-    turn_wheel(FRONT_RIGHT, 200, FORWARD);
-    SDL_Delay(100);
-    all_wheels_off();
+    // a recording starts from rest, whatever had the wheels lets go of them
+    stop_approach();
+    send(WHEELS_OFF);
+    for (int i = 0; i < SDL_CONTROLLER_AXIS_MAX; i++) axes[i].pending = false;
+    for (int i = 0; i < CInputMap::MOTIONS; i++) motion[i] = 0;
+
+    recording = true;
+    record_dir = -1;
+    record_held = -1;
+    record_start = chrono::steady_clock::now();
+    cout << "Recording Started\n";
+}
+
+void record_button(const CInputMap::binding& b, Uint32 timestamp, int& facing) {
+    if (b.command == CInputMap::FORKS_LEVEL || b.command == CInputMap::FORKS_STEP) {
+        end_segment(record_dir, -1, record_start);
+        send_forks(b, timestamp);
+
+        // the motor thread sets the new target, wait for it before reading it back
+        motors.sync();
+
+        // forks are recorded by the height they end at, both forks share a target after a level move
+        int height = forks->target(b.channel == CForkPlanner::LEFT_FORK ? CForkPlanner::LEFT_FORK : CForkPlanner::RIGHT_FORK);
+        recorder.push(CRecorder::make_record(CRecorder::FORKS, b.channel, height, -1, -1, -1));
+    } else if (b.command == CInputMap::TURN) {
+        record_turn(b.value, facing);
+    } else if (b.command == CInputMap::CAPTURE) {
+        // the capture button ends a recording
+        stop_recording(true);
+    }
+}
+
+void record_axis(Uint8 axis, Sint16 value) {
+    int dir = input.record_direction(axis, value);
+    if (dir == -2) return;
+
+    // a recorded turn has the wheels, the sticks take over once it ends
+    record_held = dir;
+    if (!sequencer.busy()) record_drive(dir);
+}
+
+void record_drive(int dir) {
+    if (dir == -1) {
+        end_segment(record_dir, -1, record_start);
+        send(WHEELS_OFF);
+        return;
+    }
 
+    double vx, vy;
+    CTurnPlanner::drive_motion(dir, vx, vy);
+    send_drive(vx, vy, 0);
+
+    if (record_dir != dir) end_segment(record_dir, dir, record_start);
+}
+
+void record_turn(int heading, int& facing) {
+    int from = facing;
+    int duration = move_forklift(heading, facing);
+    if (duration == 0) return;
+
+    // the segment before ends as the wheels start turning
+    end_segment(record_dir, -1, record_start);
+
+    // the turn stops from the routine, so the loop keeps ticking while it runs
+    int64_t duration_ns = duration * 1000000LL;
+    int to = facing;
+    CPlayback::action stop = {duration_ns, CPlayback::STOP, -1, 0, -1, -1};
+    sequencer.start(vector<CPlayback::action>(1, stop), [=](bool finished) {
+        if (!finished || !recording) return;
+
+        recorder.push(CRecorder::make_record(CRecorder::DC, -1, 200, to, duration_ns, from));
+        record_start = chrono::steady_clock::now();
+        if (record_held >= 0) record_drive(record_held);
+    });
+}
+
+void stop_recording(bool signal) {
+    // a turn cut short isn't recorded
+    recording = false;
+    sequencer.cancel();
+    end_segment(record_dir, -1, record_start);
+
+    if (signal) {
+        // turn front right wheel slightly to signify end of recording
+        send(WHEEL_TURN, FRONT_RIGHT, 200, FORWARD);
+        CPlayback::action stop = {100000000, CPlayback::STOP, -1, 0, -1, -1};
+        sequencer.start(vector<CPlayback::action>(1, stop));
+    } else {
+        send(WHEELS_OFF);
+    }
+
+    recorder.close();
     cout << "Recording Finished\n";
-    outfile.close();
+    if (recorder.dropped() > 0) cout << recorder.dropped() << " records dropped\n";
 }
 
-// motor_type, channel, steps (duty cycle), dir, duration, facing
+void end_segment(int& last_dir, int next_dir, chrono::steady_clock::time_point& start) {
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+
+    if (last_dir != -1) {
+        int64_t duration = chrono::duration_cast<chrono::nanoseconds>(now - start).count();
+        recorder.push(CRecorder::make_record(CRecorder::DC, -1, 200, last_dir, duration, -1));
+    }
+
+    start = now;
+    last_dir = next_dir;
+}
+
+
 void play_back() {
-    ifstream infile;
-    bool finished_playing = false;
-
-    string motor_type;
-    int channel, steps /*also duty_cycle*/, dir, facing, delay;
-    double duration;
-
-    infile.open("Recording.txt");
-
-
-    while (!finished_playing) {
-        infile >> motor_type >> channel >> steps >> dir >> duration >> facing;
-
-        if (motor_type == "STEPPER") {
-            if (!infile.eof()) control.set_data(control.STEPPER, channel, steps, dir);
-        } else if (motor_type == "DC") {
-            if (facing != -1) {
-                if (dir == FORWARD) delay = move_forklift(SDL_CONTROLLER_BUTTON_Y, facing);
-                else if (dir == RIGHT) delay = move_forklift(SDL_CONTROLLER_BUTTON_B, facing);
-                else if (dir == LEFT) delay = move_forklift(SDL_CONTROLLER_BUTTON_X, facing);
-                else if (dir == BACKWARD) delay = move_forklift(SDL_CONTROLLER_BUTTON_A, facing);
-
-                SDL_Delay(delay);
-                all_wheels_off();
-            } else {
-                if (dir == FORWARD) {
-                    turn_wheel(FRONT_RIGHT, steps, FORWARD);
-                    turn_wheel(FRONT_LEFT, steps, FORWARD);
-                    turn_wheel(BACK_RIGHT, steps, FORWARD);
-                    turn_wheel(BACK_LEFT, steps, FORWARD);
-                } else if (dir == BACKWARD) {
-                    turn_wheel(FRONT_RIGHT, steps, BACKWARD);
-                    turn_wheel(FRONT_LEFT, steps, BACKWARD);
-                    turn_wheel(BACK_RIGHT, steps, BACKWARD);
-                    turn_wheel(BACK_LEFT, steps, BACKWARD);
-                } else if (dir == RIGHT) {
-                    turn_wheel(FRONT_RIGHT, steps, BACKWARD);
-                    turn_wheel(FRONT_LEFT, steps, FORWARD);
-                    turn_wheel(BACK_RIGHT, steps, FORWARD);
-                    turn_wheel(BACK_LEFT, steps != 0 ? abs(steps) - 40 : steps, BACKWARD);
-                } else if (dir == LEFT) {
-                    turn_wheel(FRONT_RIGHT, steps, FORWARD);
-                    turn_wheel(FRONT_LEFT, steps, BACKWARD);
-                    turn_wheel(BACK_RIGHT, steps, BACKWARD);
-                    turn_wheel(BACK_LEFT, steps != 0 ? abs(steps) - 40 : steps, FORWARD);
-                }
+    // playback reads the fork targets, let the motor thread finish setting them
+    motors.sync();
+    vector<CRecorder::record> records;
+    vector<CPlayback::action> actions;
+
+    // recordings made before the binary format are still played
+    if (!CRecorder::load(recording_path, records) && !CRecorder::load(legacy_recording_path, records)) {
+        cout << "No recording to play back\n";
+        return;
+    }
 
-                if (!infile.eof()) {
-                    usleep(duration * 1000000);
-                    all_wheels_off();
-                    usleep(200000);
-                }
-            }
+    if (optimise_playback) {
+        CPlanOptimiser optimiser(*forks);
+        optimiser.compile(records, actions);
+        optimiser.print_report();
+    } else {
+        CPlayback(*forks).compile(records, actions);
+    }
+
+    // the main loop runs the actions as they come due, so the abort button is read throughout
+    sequencer.start(actions, [](bool finished) {
+        if (!finished) return;
+
+        sequencer.print_stats();
+        cout << "Play Back Finished\n";
+        send(WHEELS_OFF);
+    });
+    cout << "Play Back Started\n";
+}
+
+void play_action(const CPlayback::action& a) {
+    int steps /*also duty_cycle*/ = a.value, dir = a.dir, facing = a.facing;
+
+    if (a.type == CPlayback::FORKS_TO) {
+        send(FORKS_TO, a.channel, a.value);
+    } else if (a.type == CPlayback::FORKS_BY) {
+        send(FORKS_MOVE, a.channel, 0, a.value);
+    } else if (a.type == CPlayback::STOP || a.type == CPlayback::END) {
+        send(WHEELS_OFF);
+    } else if (a.type == CPlayback::TURN) {
+        move_forklift(dir, facing);
+    } else if (a.type == CPlayback::DRIVE) {
+        double vx, vy;
+        if (CTurnPlanner::drive_motion(dir, vx, vy)) send_drive(vx, vy, 0, steps);
+    }
+}
+
+int vision_benchmark(int argc, char* argv[]) {
+    CVision bench;
+    bench.set_roi(vision_roi[0], vision_roi[1], vision_roi[2], vision_roi[3]);
+
+    if (!bench.start(argv[2], !(argc >= 4 && string(argv[3]) == "fast"))) {
+        cout << "Could not open " << argv[2] << "\n";
+        return 1;
+    }
+
+    // stands in for the approach, taking each detection as it comes. Files run to the end, cameras for a fixed time
+    bool camera = argv[2][0] >= '0' && argv[2][0] <= '9';
+    int64_t end = CMotorThread::now_ns() + vision_benchmark_s * 1000000000LL;
+    unsigned long taken = 0, markers = 0;
+
+    while (true) {
+        bool running = bench.is_running();
+        const CVision::detection* d = bench.latest(100);
+
+        if (d != nullptr) {
+            taken++;
+            markers += d->markers.size();
+        }
+
+        // one more look after the threads stop picks up the last detection
+        if (!running || (camera && CMotorThread::now_ns() > end)) break;
+    }
+
+    bench.stop();
+    bench.print_stats();
+    cout << "Detections taken: " << taken << ", markers found: " << markers << "\n";
+    return 0;
+}
+
+int turn_test(int argc, char* argv[]) {
+    cv::VideoCapture video;
+    if (!video.open(argv[2])) {
+        cout << "Could not open " << argv[2] << "\n";
+        return 1;
+    }
+
+    // every frame in order, as if the control tick kept up with the camera
+    CTurnTracker test(camera_fov_deg);
+    cv::Mat image;
+    unsigned long measured = 0;
+    while (video.read(image) && !image.empty()) {
+        if (test.add(image)) measured++;
+    }
+
+    double expected = atof(argv[3]);
+    cout << "Turned " << test.get_yaw() << " degrees (clockwise positive), expected " << expected << ", error "
+         << test.get_yaw() - expected << " over " << measured << " measured frames\n";
+    test.print_stats();
+    return 0;
+}
+
+int remote_benchmark(int argc, char* argv[]) {
+    CRemote client;
+    int packets = argc >= 4 ? atoi(argv[3]) : 10000;
+
+    if (packets <= 0 || !client.open(argv[2], false)) {
+        cout << "Could not open " << argv[2] << "\n";
+        return 1;
+    }
+
+    // a full batch of NOPs, so nothing moves but every packet is the largest there is
+    CRemote::command batch[CRemote::MAX_COMMANDS];
+    memset(batch, 0, sizeof(batch));
+
+    vector<int64_t> round_trips;
+    round_trips.reserve(packets);
+    unsigned long lost = 0;
+
+    for (int i = 0; i < packets; i++) {
+        CRemote::header h;
+        memset(&h, 0, sizeof(h));
+        h.flags = CRemote::ACK;
+        h.seq = i + 1;
+        h.sent_ns = CRemote::now_ns();
+
+        if (!client.send(h, batch, CRemote::MAX_COMMANDS)) {
+            cout << "Could not send to " << argv[2] << "\n";
+            return 1;
+        }
+
+        // a late reply to an earlier packet is skipped
+        CRemote::header r;
+        bool answered = false;
+        while (!answered && client.wait_reply(r, 100)) answered = r.seq == h.seq;
+
+        if (answered) round_trips.push_back(CRemote::now_ns() - r.sent_ns);
+        else lost++;
+    }
+
+    client.close();
+
+    if (round_trips.empty()) {
+        cout << "No replies from " << argv[2] << "\n";
+        return 1;
+    }
+
+    sort(round_trips.begin(), round_trips.end());
+    int64_t sum = 0;
+    for (size_t i = 0; i < round_trips.size(); i++) sum += round_trips[i];
+
+    cout << "Round trips: " << round_trips.size() << " (" << lost << " lost), avg " << sum / (double)round_trips.size() / 1000
+         << " us, median " << round_trips[round_trips.size() / 2] / 1000.0 << " us, 99th percentile "
+         << round_trips[round_trips.size() * 99 / 100] / 1000.0 << " us, max " << round_trips.back() / 1000.0 << " us\n";
+    return 0;
+}
+
+int simulate(int argc, char* argv[]) {
+    vector<CKinematicSim::job> jobs;
+
+    if (string(argv[1]) == "--simulate") {
+        for (int i = 2; i < argc; i++) {
+            CKinematicSim::job j = CKinematicSim::default_job(argv[i]);
+            j.optimise = optimise_playback;
+            jobs.push_back(j);
+        }
+    } else {
+        string setting = argc == 7 ? argv[3] : "";
+        double first = argc == 7 ? atof(argv[4]) : 0;
+        double last = argc == 7 ? atof(argv[5]) : 0;
+        double step = argc == 7 ? atof(argv[6]) : 0;
+
+        if (step <= 0 || (setting != "turn_90" && setting != "turn_180" && setting != "strafe_gain")) {
+            cout << "Usage: Forklift --sweep <recording> <turn_90|turn_180|strafe_gain> <first> <last> <step>\n";
+            return 1;
         }
 
-        finished_playing = infile.eof();
+        // counting steps rather than adding them up keeps the last value from being missed to rounding
+        for (int k = 0; first + k * step <= last + step * 1e-9; k++) {
+            double value = first + k * step;
+            CKinematicSim::job j = CKinematicSim::default_job(argv[2]);
+            j.optimise = optimise_playback;
+
+            if (setting == "turn_90") j.turn_90_ms = (int)lround(value);
+            else if (setting == "turn_180") j.turn_180_ms = (int)lround(value);
+            else j.strafe_gain = value;
+
+            jobs.push_back(j);
+        }
     }
 
-    infile.close();
-    cout << "Play Back Finished\n";
-    all_wheels_off();
+    // the model works out fork move times from a planner on the simulator backend, never the real pins
+    CSimBackend backend;
+    CControl sim_control(backend);
+    CForkPlanner sim_forks(sim_control);
+
+    CKinematicSim sim(sim_forks);
+    vector<CKinematicSim::result> results;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    sim.run_batch(jobs, results);
+    double wall = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    CKinematicSim::print_results(jobs, results);
+
+    // the summary goes to stderr so the results can be piped straight into a spreadsheet
+    double simulated = 0;
+    for (size_t i = 0; i < results.size(); i++) simulated += results[i].cycle_s;
+    cerr << jobs.size() << " runs, " << simulated << " s simulated in " << wall << " s on " << thread::hardware_concurrency() << " cores\n";
+
+    return 0;
 }